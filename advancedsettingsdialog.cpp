@@ -1,5 +1,6 @@
 // advancedsettingsdialog.cpp
 #include "advancedsettingsdialog.h"
+#include <limits>
 #include <random>
 #include <QDebug>
 
@@ -26,10 +27,10 @@ void AdvancedSettingsDialog::setupUi() {
     
     grid->addWidget(new QLabel("Layers:"), row, 0);
     maxLayersSlider = new QSlider(Qt::Horizontal);
-    maxLayersSlider->setRange(1, 20);
+    maxLayersSlider->setRange(1, MAX_TUNNEL_LAYERS);
     grid->addWidget(maxLayersSlider, row, 1);
     maxLayersSpinBox = new QSpinBox();
-    maxLayersSpinBox->setRange(1, 20);
+    maxLayersSpinBox->setRange(1, MAX_TUNNEL_LAYERS);
     maxLayersSpinBox->setFixedWidth(80);
     grid->addWidget(maxLayersSpinBox, row, 2);
     row++;
@@ -70,10 +71,17 @@ void AdvancedSettingsDialog::setupUi() {
     
     grid->addWidget(new QLabel("Star Pattern:"), row, 0);
     starfieldPatternCombo = new QComboBox();
-    starfieldPatternCombo->addItems({"None", "Random", "Spiral"});
+    for (const std::string& name : enumNames(StarfieldPattern())) starfieldPatternCombo->addItem(QString::fromStdString(name));
     grid->addWidget(starfieldPatternCombo, row, 1, 1, 2);
     row++;
 
+    grid->addWidget(new QLabel("Star Seed:"), row, 0);
+    seedSpinBox = new QSpinBox();
+    seedSpinBox->setRange(0, std::numeric_limits<int>::max());
+    seedSpinBox->setSpecialValueText("Random"); // 0: a different starfield on every render
+    grid->addWidget(seedSpinBox, row, 1, 1, 2);
+    row++;
+
     grid->addWidget(new QLabel("Pixelation:"), row, 0);
     pixelationSlider = new QSlider(Qt::Horizontal);
     pixelationSlider->setRange(0, 10);
@@ -84,6 +92,12 @@ void AdvancedSettingsDialog::setupUi() {
     grid->addWidget(pixelationSpinBox, row, 2);
     row++;
 
+    grid->addWidget(new QLabel("Pixel Shape:"), row, 0);
+    pixelationShapeCombo = new QComboBox();
+    for (const std::string& name : enumNames(PixelationShape())) pixelationShapeCombo->addItem(QString::fromStdString(name));
+    grid->addWidget(pixelationShapeCombo, row, 1, 1, 2);
+    row++;
+
     grid->addWidget(new QLabel("Invert Freq:"), row, 0);
     colorInvertSlider = new QSlider(Qt::Horizontal);
     colorInvertSlider->setRange(0, 60);
@@ -120,7 +134,7 @@ void AdvancedSettingsDialog::setupUi() {
     
     grid->addWidget(new QLabel("Wave Dir:"), row, 0);
     waveDirectionCombo = new QComboBox();
-    waveDirectionCombo->addItems({"None", "Horizontal", "Vertical"});
+    for (const std::string& name : enumNames(WaveDirection())) waveDirectionCombo->addItem(QString::fromStdString(name));
     grid->addWidget(waveDirectionCombo, row, 1, 1, 2);
     
     mainLayout->addWidget(advancedSettingsGroup);
@@ -166,8 +180,10 @@ void AdvancedSettingsDialog::setupConnections() {
     connectDoubleSlider(waveAmplitudeSlider, waveAmplitudeSpinBox, settingsPtr->wave_amplitude);
     connectDoubleSlider(waveFrequencySlider, waveFrequencySpinBox, settingsPtr->wave_frequency, 100.0);
 
-    connect(starfieldPatternCombo, &QComboBox::currentTextChanged, this, [this](const QString& text){ settingsPtr->advanced_starfield_pattern = text.toStdString(); });
-    connect(waveDirectionCombo, &QComboBox::currentTextChanged, this, [this](const QString& text){ settingsPtr->wave_direction = text.toStdString(); });
+    connect(seedSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int val){ settingsPtr->seed = val; });
+    connect(starfieldPatternCombo, &QComboBox::currentTextChanged, this, [this](const QString& text){ parseEnum(text.toStdString(), settingsPtr->advanced_starfield_pattern); });
+    connect(waveDirectionCombo, &QComboBox::currentTextChanged, this, [this](const QString& text){ parseEnum(text.toStdString(), settingsPtr->wave_direction); });
+    connect(pixelationShapeCombo, &QComboBox::currentTextChanged, this, [this](const QString& text){ parseEnum(text.toStdString(), settingsPtr->pixelation_shape); });
     
     connect(randomizeButton, &QPushButton::clicked, this, &AdvancedSettingsDialog::randomizeSettingsInDialog);
     connect(defaultButton, &QPushButton::clicked, this, &AdvancedSettingsDialog::resetToDefaultsInDialog);
@@ -176,24 +192,8 @@ void AdvancedSettingsDialog::setupConnections() {
 void AdvancedSettingsDialog::randomizeSettingsInDialog() {
     std::random_device rd;
     std::mt19937 gen(rd());
-    
-    settingsPtr->rotation_speed = std::uniform_real_distribution<>(0.0, 10.0)(gen);
-    settingsPtr->hue_speed = std::uniform_real_distribution<>(0.0, 15.0)(gen);
-    settingsPtr->hue_intensity = std::uniform_real_distribution<>(0.0, 1.5)(gen);
-    
-    settingsPtr->max_layers = std::uniform_int_distribution<>(5, 20)(gen);
-    settingsPtr->blur_radius = std::uniform_real_distribution<>(0.0, 3.0)(gen);
-    settingsPtr->vignette_strength = std::uniform_real_distribution<>(0.0, 0.75)(gen);
-    settingsPtr->num_stars = std::uniform_int_distribution<>(0, 500)(gen);
-    settingsPtr->advanced_starfield_pattern = starfieldPatternCombo->itemText(std::uniform_int_distribution<>(0, 2)(gen)).toStdString();
-    settingsPtr->pixelation_level = std::uniform_int_distribution<>(0, 10)(gen);
-    settingsPtr->color_invert_frequency = std::uniform_int_distribution<>(0, 40)(gen);
-    settingsPtr->wave_amplitude = std::uniform_real_distribution<>(0.0, 25.0)(gen);
-    settingsPtr->wave_frequency = std::uniform_real_distribution<>(0.0, 0.75)(gen);
-    settingsPtr->wave_direction = waveDirectionCombo->itemText(std::uniform_int_distribution<>(0, 2)(gen)).toStdString();
-    
-    settingsPtr->oscillating_zoom_midpoint = std::uniform_real_distribution<>(0.8, 1.2)(gen);
-    
+    *settingsPtr = GifSettings::randomized(*settingsPtr, gen);
+
     updateDialogUiFromSettings();
     emit settingsChanged();
 }
@@ -218,16 +218,18 @@ void AdvancedSettingsDialog::updateDialogUiFromSettings() {
     vignetteSpinBox->setValue(settingsPtr->vignette_strength);
     numStarsSlider->setValue(settingsPtr->num_stars);
     numStarsSpinBox->setValue(settingsPtr->num_stars);
-    starfieldPatternCombo->setCurrentText(QString::fromStdString(settingsPtr->advanced_starfield_pattern));
+    starfieldPatternCombo->setCurrentText(QString::fromStdString(enumName(settingsPtr->advanced_starfield_pattern)));
+    seedSpinBox->setValue(settingsPtr->seed);
     pixelationSlider->setValue(settingsPtr->pixelation_level);
     pixelationSpinBox->setValue(settingsPtr->pixelation_level);
+    pixelationShapeCombo->setCurrentText(QString::fromStdString(enumName(settingsPtr->pixelation_shape)));
     colorInvertSlider->setValue(settingsPtr->color_invert_frequency);
     colorInvertSpinBox->setValue(settingsPtr->color_invert_frequency);
     waveAmplitudeSlider->setValue(static_cast<int>(settingsPtr->wave_amplitude * 10));
     waveAmplitudeSpinBox->setValue(settingsPtr->wave_amplitude);
     waveFrequencySlider->setValue(static_cast<int>(settingsPtr->wave_frequency * 100));
     waveFrequencySpinBox->setValue(settingsPtr->wave_frequency);
-    waveDirectionCombo->setCurrentText(QString::fromStdString(settingsPtr->wave_direction));
+    waveDirectionCombo->setCurrentText(QString::fromStdString(enumName(settingsPtr->wave_direction)));
 
     // Unblock signals
     for(auto widget : this->findChildren<QWidget*>()) {
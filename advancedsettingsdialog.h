@@ -41,8 +41,10 @@ private:
     QSlider* numStarsSlider;
     QSpinBox* numStarsSpinBox;
     QComboBox* starfieldPatternCombo;
+    QSpinBox* seedSpinBox;
     QSlider* pixelationSlider;
     QSpinBox* pixelationSpinBox;
+    QComboBox* pixelationShapeCombo;
     QSlider* colorInvertSlider;
     QSpinBox* colorInvertSpinBox;
     QSlider* waveAmplitudeSlider;
@@ -0,0 +1,359 @@
+// batch_runner.cpp
+#include "batch_runner.h"
+#include "frame_renderer.h"
+#include "gif_settings_json.h"
+#include "gif_worker.h"
+#include "mat_pool.h"
+#include "render_cache.h"
+#include "stage_timer.h"
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonParseError>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <opencv2/opencv.hpp>
+
+namespace {
+
+class BatchJobTask : public QRunnable {
+public:
+    explicit BatchJobTask(std::function<void()> work) : m_work(std::move(work)) {}
+    void run() override { m_work(); }
+
+private:
+    std::function<void()> m_work;
+};
+
+// Frame-sized buffers alive at once while a job renders: the frame, the
+// layer and warp temporaries, the RGBA output and gif-h's previous frame.
+const int JOB_FRAME_BUFFERS = 8;
+// Compressed images rarely expand by more than this when decoded to BGRA.
+const int DECODE_EXPANSION = 8;
+
+// Counts reserved bytes and blocks reservations that would exceed the
+// budget. A reservation is always granted when nothing else holds one, so
+// a job larger than the whole budget still runs, just on its own.
+class MemoryBudget {
+public:
+    explicit MemoryBudget(qint64 budget_bytes) : m_budget_bytes(budget_bytes) {}
+
+    void acquire(qint64 bytes) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_released.wait(lock, [&]() { return m_used_bytes == 0 || m_used_bytes + bytes <= m_budget_bytes; });
+        m_used_bytes += bytes;
+    }
+
+    void release(qint64 bytes) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_used_bytes -= bytes;
+        }
+        m_released.notify_all();
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    qint64 m_budget_bytes;
+    qint64 m_used_bytes = 0;
+};
+
+BatchJobResult runJob(const BatchJob& job, int index, bool record_checksums,
+                      const std::shared_ptr<RenderCache>& cache, const std::atomic<bool>* cancel_flag) {
+    BatchJobResult result;
+    result.index = index;
+    result.input_path = job.settings.image_path;
+    result.output_path = job.output_path;
+    if (cancel_flag && *cancel_flag) {
+        result.status = "cancelled";
+        result.message = "Batch cancelled before the job started.";
+        return result;
+    }
+    QString settings_error;
+    if (!validateSettings(job.settings, &settings_error)) {
+        result.status = "settings_error";
+        result.message = settings_error.toStdString();
+        return result;
+    }
+
+    std::shared_ptr<StageProfile> profile = std::make_shared<StageProfile>();
+    result.profile = profile;
+    QElapsedTimer timer;
+    timer.start();
+    // A job the cache can serve never needs its source decoded.
+    QByteArray source_digest = cache ? RenderCache::sourceDigest(job.settings.image_path) : QByteArray();
+    bool cached = cache && cache->contains(RenderCache::key(source_digest, job.settings));
+    cv::Mat working_source = job.working_source;
+    if (working_source.empty() && !cached) {
+        StageProfileScope profile_scope(profile.get());
+        working_source = loadSourceImage(job.settings.image_path, GIF_WORKING_SIZE, cv::INTER_LANCZOS4);
+    }
+    result.load_msecs = timer.restart();
+    if (working_source.empty() && !cached) {
+        result.status = "input_error";
+        result.message = "Could not load input image.";
+        return result;
+    }
+
+    // The worker runs on this pool thread, so its signals are delivered directly.
+    GifWorker worker(job.settings, job.output_path, working_source, job.stage_cache);
+    worker.setStageProfile(profile);
+    worker.setCancelFlag(cancel_flag);
+    worker.setRecordChecksums(record_checksums);
+    worker.setRenderCache(cache, source_digest);
+    bool success = false;
+    QObject::connect(&worker, &GifWorker::finished, [&](bool ok, const QString& pathOrMessage) {
+        success = ok;
+        if (!ok) result.message = pathOrMessage.toStdString();
+    });
+    worker.process();
+    trimThreadMatPool();
+    result.render_msecs = timer.elapsed();
+    result.seed = worker.seed();
+    result.frame_checksums = worker.frameChecksums();
+    result.cache_hit = worker.cacheHit();
+
+    if (success) {
+        result.status = "ok";
+        result.output_bytes = QFileInfo(QString::fromStdString(job.output_path)).size();
+    } else {
+        result.status = (cancel_flag && *cancel_flag) ? "cancelled" : "render_error";
+    }
+    return result;
+}
+
+} // namespace
+
+QJsonObject BatchJobResult::toJson() const {
+    QJsonObject json{
+        {"index", index},
+        {"input", QString::fromStdString(input_path)},
+        {"output", QString::fromStdString(output_path)},
+        {"status", QString::fromStdString(status)},
+        {"message", QString::fromStdString(message)},
+        {"load_ms", load_msecs},
+        {"render_ms", render_msecs},
+        {"output_bytes", output_bytes},
+        {"cache_hit", cache_hit}};
+    if (seed != 0) json.insert("seed", seed);
+    if (!frame_checksums.empty()) {
+        json.insert("checksum", QString("%1").arg(static_cast<qulonglong>(combineChecksums(frame_checksums)), 16, 16, QChar('0')));
+    }
+    if (profile) {
+        json.insert("stages", profile->toJson());
+        json.insert("allocations", profile->allocations().toJson());
+    }
+    return json;
+}
+
+bool loadBatchManifest(const QString& path, const GifSettings& base_settings,
+                       std::vector<BatchJob>& jobs, QString* error) {
+    auto setError = [error](const QString& message) {
+        if (error) *error = message;
+        return false;
+    };
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return setError(QString("Cannot open manifest '%1'.").arg(path));
+    }
+    QJsonParseError parse_error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parse_error);
+    if (!document.isObject()) {
+        return setError(QString("Manifest '%1' is not a JSON object: %2").arg(path, parse_error.errorString()));
+    }
+    QJsonObject manifest = document.object();
+    QDir base_dir = QFileInfo(path).absoluteDir();
+
+    GifSettings defaults = base_settings;
+    QString settings_error;
+    if (manifest.contains("defaults") && !settingsFromJson(manifest.value("defaults").toObject(), defaults, &settings_error)) {
+        return setError(QString("Manifest defaults: %1").arg(settings_error));
+    }
+
+    QJsonArray entries = manifest.value("jobs").toArray();
+    if (entries.isEmpty()) {
+        return setError(QString("Manifest '%1' has no jobs.").arg(path));
+    }
+
+    // Jobs that render the same image share its frame-independent stages.
+    // Images used only once get no shared cache, so theirs is freed with
+    // the job instead of lasting for the whole batch.
+    std::map<std::string, int> image_uses;
+    jobs.clear();
+    for (int i = 0; i < entries.size(); ++i) {
+        QJsonObject entry = entries.at(i).toObject();
+        QString input = entry.value("input").toString();
+        QString output = entry.value("output").toString();
+        if (input.isEmpty() || output.isEmpty()) {
+            return setError(QString("Job %1 needs both \"input\" and \"output\".").arg(i));
+        }
+
+        BatchJob job;
+        job.settings = defaults;
+        if (entry.contains("settings") && !settingsFromJson(entry.value("settings").toObject(), job.settings, &settings_error)) {
+            return setError(QString("Job %1: %2").arg(i).arg(settings_error));
+        }
+        job.settings.image_path = QDir::cleanPath(base_dir.absoluteFilePath(input)).toStdString();
+        job.output_path = QDir::cleanPath(base_dir.absoluteFilePath(output)).toStdString();
+        ++image_uses[job.settings.image_path];
+        jobs.push_back(job);
+    }
+
+    std::map<std::string, std::shared_ptr<RenderStageCache>> stage_caches;
+    for (BatchJob& job : jobs) {
+        if (image_uses[job.settings.image_path] < 2) continue;
+        std::shared_ptr<RenderStageCache>& stage_cache = stage_caches[job.settings.image_path];
+        if (!stage_cache) stage_cache = std::make_shared<RenderStageCache>();
+        job.stage_cache = stage_cache;
+    }
+    return true;
+}
+
+bool loadSweepManifest(const QString& path, const GifSettings& base_settings,
+                       std::vector<BatchJob>& jobs, QString* error) {
+    auto setError = [error](const QString& message) {
+        if (error) *error = message;
+        return false;
+    };
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return setError(QString("Cannot open sweep '%1'.").arg(path));
+    }
+    QJsonParseError parse_error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parse_error);
+    if (!document.isObject()) {
+        return setError(QString("Sweep '%1' is not a JSON object: %2").arg(path, parse_error.errorString()));
+    }
+    QJsonObject sweep = document.object();
+    QDir base_dir = QFileInfo(path).absoluteDir();
+
+    QString input = sweep.value("input").toString();
+    QString output_pattern = sweep.value("output").toString();
+    if (input.isEmpty() || output_pattern.isEmpty()) {
+        return setError("A sweep needs both \"input\" and \"output\".");
+    }
+
+    GifSettings defaults = base_settings;
+    QString settings_error;
+    if (sweep.contains("defaults") && !settingsFromJson(sweep.value("defaults").toObject(), defaults, &settings_error)) {
+        return setError(QString("Sweep defaults: %1").arg(settings_error));
+    }
+    defaults.image_path = QDir::cleanPath(base_dir.absoluteFilePath(input)).toStdString();
+
+    // Each variant is a set of overrides on top of the defaults.
+    std::vector<QJsonObject> variants;
+    for (const QJsonValue& variant : sweep.value("variants").toArray()) {
+        variants.push_back(variant.toObject());
+    }
+    if (variants.empty()) {
+        variants.push_back(QJsonObject());
+    }
+    QJsonObject grid = sweep.value("grid").toObject();
+    for (const QString& key : grid.keys()) {
+        QJsonArray values = grid.value(key).toArray();
+        if (values.isEmpty()) {
+            return setError(QString("Grid setting '%1' needs a non-empty array of values.").arg(key));
+        }
+        std::vector<QJsonObject> expanded;
+        for (const QJsonObject& variant : variants) {
+            for (const QJsonValue& value : values) {
+                QJsonObject point = variant;
+                point.insert(key, value);
+                expanded.push_back(point);
+            }
+        }
+        variants.swap(expanded);
+    }
+
+    std::shared_ptr<RenderStageCache> stage_cache = std::make_shared<RenderStageCache>();
+
+    int index_width = QString::number(static_cast<int>(variants.size()) - 1).size();
+    jobs.clear();
+    for (size_t i = 0; i < variants.size(); ++i) {
+        BatchJob job;
+        job.settings = defaults;
+        if (!settingsFromJson(variants[i], job.settings, &settings_error)) {
+            return setError(QString("Variant %1: %2").arg(i).arg(settings_error));
+        }
+        job.settings.image_path = defaults.image_path;
+        QString output = output_pattern;
+        output.replace("{index}", QString("%1").arg(static_cast<int>(i), index_width, 10, QChar('0')));
+        job.output_path = QDir::cleanPath(base_dir.absoluteFilePath(output)).toStdString();
+        job.stage_cache = stage_cache;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+bool prepareSharedSource(std::vector<BatchJob>& jobs) {
+    if (jobs.empty()) return true;
+    cv::Mat working_source = loadSourceImage(jobs.front().settings.image_path, GIF_WORKING_SIZE, cv::INTER_LANCZOS4);
+    if (working_source.empty()) return false;
+    for (BatchJob& job : jobs) {
+        job.working_source = working_source;
+    }
+    return true;
+}
+
+BatchRunner::BatchRunner(int max_parallel_jobs, qint64 memory_budget_bytes)
+    : m_max_parallel_jobs(std::max(1, max_parallel_jobs)), m_memory_budget_bytes(memory_budget_bytes) {}
+
+qint64 BatchRunner::estimateJobBytes(const BatchJob& job) {
+    // GifWorker renders one frame per OpenCV thread at a time.
+    qint64 frame_bytes = static_cast<qint64>(GIF_WORKING_SIZE) * GIF_WORKING_SIZE * 4;
+    qint64 render_bytes = frame_bytes * JOB_FRAME_BUFFERS * std::max(1, cv::getNumThreads()) +
+                          static_cast<qint64>(tunnelCompositeBytes(job.settings, cv::Size(GIF_WORKING_SIZE, GIF_WORKING_SIZE)));
+    if (!job.working_source.empty()) {
+        return render_bytes; // Decoded once, outside the job
+    }
+    qint64 input_bytes = QFileInfo(QString::fromStdString(job.settings.image_path)).size();
+    return render_bytes + input_bytes * DECODE_EXPANSION;
+}
+
+std::vector<BatchJobResult> BatchRunner::run(const std::vector<BatchJob>& jobs,
+                                             const std::function<void(const BatchJobResult&)>& on_job_finished,
+                                             const std::atomic<bool>* cancel_flag) {
+    int parallel_jobs = std::min<int>(m_max_parallel_jobs, static_cast<int>(jobs.size()));
+    QThreadPool pool;
+    pool.setMaxThreadCount(std::max(1, parallel_jobs));
+
+    // OpenCV's thread pool runs one parallel_for_ at a time; a second one,
+    // from another job, runs serially on its caller. So when jobs run
+    // together, each renders its frames one at a time on its own pool
+    // thread, with OpenCV's threading off. A job running alone keeps every
+    // core for its frames.
+    int previous_cv_threads = cv::getNumThreads();
+    if (parallel_jobs > 1) cv::setNumThreads(1);
+
+    // The Mat pools may keep their whole budget past any one job, so it
+    // comes off the top of the jobs' budget.
+    MemoryBudget budget(m_memory_budget_bytes - static_cast<qint64>(MAT_POOL_MAX_CACHED_BYTES));
+    std::mutex report_mutex;
+    std::vector<BatchJobResult> results(jobs.size());
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        pool.start(new BatchJobTask([&, i]() {
+            qint64 reserved = estimateJobBytes(jobs[i]);
+            budget.acquire(reserved);
+            BatchJobResult result = runJob(jobs[i], static_cast<int>(i), m_record_checksums, m_cache, cancel_flag);
+            budget.release(reserved);
+
+            std::lock_guard<std::mutex> lock(report_mutex);
+            results[i] = result;
+            if (on_job_finished) on_job_finished(result);
+        }));
+    }
+    pool.waitForDone();
+
+    cv::setNumThreads(previous_cv_threads);
+    return results;
+}
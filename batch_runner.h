@@ -0,0 +1,107 @@
+// batch_runner.h
+#ifndef BATCH_RUNNER_H
+#define BATCH_RUNNER_H
+
+#include <QJsonObject>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "gif_settings.h"
+#include "frame_renderer.h"
+
+class StageProfile;
+class RenderCache;
+
+// One GIF to render in batch mode. settings.image_path is the input.
+struct BatchJob {
+    GifSettings settings;
+    std::string output_path;
+    // Set when several jobs render the same image. In a sweep the source is
+    // then prepared once up front; in a batch, jobs on the same image share
+    // the frame-independent stages.
+    cv::Mat working_source;
+    std::shared_ptr<RenderStageCache> stage_cache;
+};
+
+struct BatchJobResult {
+    int index = 0; // Position of the job in the manifest
+    std::string input_path;
+    std::string output_path;
+    std::string status; // "ok", "settings_error", "input_error", "render_error" or "cancelled"
+    std::string message;
+    qint64 load_msecs = 0;
+    qint64 render_msecs = 0;
+    qint64 output_bytes = 0;
+    std::shared_ptr<const StageProfile> profile; // Where the job spent its time; null if it never started
+    int seed = 0; // Starfield seed the job rendered with
+    std::vector<std::uint64_t> frame_checksums; // Only with BatchRunner::setRecordChecksums()
+    bool cache_hit = false; // Copied from the render cache instead of rendered
+
+    bool succeeded() const { return status == "ok"; }
+    QJsonObject toJson() const;
+};
+
+// Reads a manifest of the form
+//   { "defaults": { <settings> },
+//     "jobs": [ { "input": "a.png", "output": "a.gif", "settings": { <settings> } }, ... ] }
+// Job settings override "defaults", which override `base_settings`.
+// Relative paths are resolved against the manifest's directory.
+bool loadBatchManifest(const QString& path, const GifSettings& base_settings,
+                       std::vector<BatchJob>& jobs, QString* error = nullptr);
+
+// Reads a sweep: one input rendered under many settings variants,
+//   { "input": "photo.png", "output": "out/photo_{index}.gif",
+//     "defaults": { <settings> },
+//     "variants": [ { <settings> }, ... ],
+//     "grid": { "hue_speed": [2, 6, 10], "scale_decay": [0.85, 0.92] } }
+// Every variant is combined with every point of the grid; either may be
+// left out. "{index}" in the output is replaced by the variant number. The
+// jobs share one RenderStageCache; prepareSharedSource() then decodes the
+// input once for all of them.
+bool loadSweepManifest(const QString& path, const GifSettings& base_settings,
+                       std::vector<BatchJob>& jobs, QString* error = nullptr);
+
+// Prepares the input of `jobs`, which must all render the same image, once
+// and hands it to every job. Returns false if the image cannot be loaded.
+bool prepareSharedSource(std::vector<BatchJob>& jobs);
+
+// Renders many GIFs at once on a shared thread pool. When several jobs run
+// at once, the parallelism is across jobs: each renders its frames one at
+// a time on its own thread, with OpenCV's threading off. With one job at a
+// time, that job renders windows of frames in parallel on every core. A job
+// only starts once its estimated memory fits in the budget alongside the
+// jobs already running.
+class BatchRunner {
+public:
+    BatchRunner(int max_parallel_jobs, qint64 memory_budget_bytes);
+
+    // Records frameChecksum() of every frame of every job.
+    void setRecordChecksums(bool record) { m_record_checksums = record; }
+    // Serves repeated jobs from `cache` and adds new renders to it.
+    void setRenderCache(std::shared_ptr<RenderCache> cache) { m_cache = std::move(cache); }
+
+    // Runs every job and returns the results in manifest order.
+    // `on_job_finished` is called from worker threads, one call at a time.
+    // Setting `cancel_flag` stops running jobs after their current frame
+    // and skips the ones not started yet.
+    std::vector<BatchJobResult> run(const std::vector<BatchJob>& jobs,
+                                    const std::function<void(const BatchJobResult&)>& on_job_finished,
+                                    const std::atomic<bool>* cancel_flag = nullptr);
+
+    // Rough peak memory of one job: the decoded input plus the renderer's
+    // and encoder's frame buffers, for as many frames as render at once.
+    static qint64 estimateJobBytes(const BatchJob& job);
+
+private:
+    int m_max_parallel_jobs;
+    qint64 m_memory_budget_bytes;
+    bool m_record_checksums = false;
+    std::shared_ptr<RenderCache> m_cache;
+};
+
+#endif // BATCH_RUNNER_H
@@ -0,0 +1,138 @@
+// box_blur.cpp
+#include "box_blur.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace {
+
+const int BOX_PASSES = 3;
+// Below this a box approximates a Gaussian poorly, and GaussianBlur's
+// kernel is short enough to be cheap.
+const double MIN_BOX_SIGMA = 1.0;
+// Above this the image is shrunk so that about this much sigma is left.
+const double MAX_FULL_SIZE_SIGMA = 8.0;
+// Rows per parallel band of a vertical pass, at least.
+const int MIN_BAND_ROWS = 32;
+
+const int SCALE_BITS = 16;
+
+// Widths of BOX_PASSES odd boxes whose stacked variance is closest to a
+// Gaussian's (Kovesi, "Fast Almost-Gaussian Filtering", 2010).
+void boxWidths(double sigma, int widths[BOX_PASSES]) {
+    double variance = 12.0 * sigma * sigma;
+    int lower = static_cast<int>(std::floor(std::sqrt(variance / BOX_PASSES + 1.0)));
+    if (lower % 2 == 0) --lower;
+    int upper = lower + 2;
+    int lower_count = static_cast<int>(std::lround(
+        (variance - BOX_PASSES * lower * lower - 4.0 * BOX_PASSES * lower - 3.0 * BOX_PASSES) / (-4.0 * lower - 4.0)));
+    for (int i = 0; i < BOX_PASSES; ++i) {
+        widths[i] = (i < lower_count) ? lower : upper;
+    }
+}
+
+// A sum of `width` values times the result is their mean in SCALE_BITS
+// fixed point.
+unsigned meanScale(int width) {
+    return ((1u << SCALE_BITS) + width / 2) / width;
+}
+
+// All of the horizontal passes, one row at a time, so each row stays in
+// cache through them.
+void blurRows(const cv::Mat& src, cv::Mat& dst, const int widths[BOX_PASSES], const cv::Range& rows) {
+    int cols = src.cols;
+    int channels = src.channels();
+    int max_radius = *std::max_element(widths, widths + BOX_PASSES) / 2;
+    std::vector<uchar> padded((cols + 2 * max_radius) * channels);
+    std::vector<unsigned> sums(channels);
+
+    for (int r = rows.start; r < rows.end; ++r) {
+        const uchar* input = src.ptr<uchar>(r);
+        uchar* output = dst.ptr<uchar>(r);
+        for (int pass = 0; pass < BOX_PASSES; ++pass) {
+            int radius = widths[pass] / 2;
+            unsigned scale = meanScale(widths[pass]);
+            for (int i = -radius; i < cols + radius; ++i) {
+                const uchar* pixel = input + cv::borderInterpolate(i, cols, cv::BORDER_REFLECT_101) * channels;
+                std::copy(pixel, pixel + channels, &padded[(i + radius) * channels]);
+            }
+            std::fill(sums.begin(), sums.end(), 0u);
+            for (int i = 0; i < 2 * radius + 1; ++i) {
+                for (int k = 0; k < channels; ++k) sums[k] += padded[i * channels + k];
+            }
+            const uchar* leaving = padded.data();
+            const uchar* entering = padded.data() + (2 * radius + 1) * channels;
+            for (int c = 0; c < cols; ++c) {
+                for (int k = 0; k < channels; ++k) {
+                    output[c * channels + k] = static_cast<uchar>((sums[k] * scale + (1u << (SCALE_BITS - 1))) >> SCALE_BITS);
+                }
+                if (c + 1 == cols) break;
+                for (int k = 0; k < channels; ++k) sums[k] += entering[k] - leaving[k];
+                entering += channels;
+                leaving += channels;
+            }
+            input = output; // The next pass blurs this one's result
+        }
+    }
+}
+
+// One vertical pass. Each band starts its column sums afresh, then slides
+// them down a row at a time across the whole width, which vectorizes.
+void blurColumns(const cv::Mat& src, cv::Mat& dst, int width) {
+    int radius = width / 2;
+    unsigned scale = meanScale(width);
+    int row_length = src.cols * src.channels();
+    int band_rows = std::max(MIN_BAND_ROWS, 2 * width); // Keeps the fresh start a small part of a band
+    int num_bands = (src.rows + band_rows - 1) / band_rows;
+
+    cv::parallel_for_(cv::Range(0, num_bands), [&](const cv::Range& bands) {
+        std::vector<unsigned> sums(row_length);
+        for (int band = bands.start; band < bands.end; ++band) {
+            int first_row = band * band_rows;
+            int end_row = std::min(src.rows, first_row + band_rows);
+            std::fill(sums.begin(), sums.end(), 0u);
+            for (int i = first_row - radius; i <= first_row + radius; ++i) {
+                const uchar* row = src.ptr<uchar>(cv::borderInterpolate(i, src.rows, cv::BORDER_REFLECT_101));
+                for (int x = 0; x < row_length; ++x) sums[x] += row[x];
+            }
+            for (int r = first_row; r < end_row; ++r) {
+                uchar* output = dst.ptr<uchar>(r);
+                for (int x = 0; x < row_length; ++x) {
+                    output[x] = static_cast<uchar>((sums[x] * scale + (1u << (SCALE_BITS - 1))) >> SCALE_BITS);
+                }
+                if (r + 1 == end_row) break;
+                const uchar* entering = src.ptr<uchar>(cv::borderInterpolate(r + radius + 1, src.rows, cv::BORDER_REFLECT_101));
+                const uchar* leaving = src.ptr<uchar>(cv::borderInterpolate(r - radius, src.rows, cv::BORDER_REFLECT_101));
+                for (int x = 0; x < row_length; ++x) sums[x] += entering[x] - leaving[x];
+            }
+        }
+    });
+}
+
+} // namespace
+
+void stackedBoxBlur(cv::Mat& image, double sigma) {
+    if (image.empty() || sigma <= 0.0) return;
+    if (sigma < MIN_BOX_SIGMA) {
+        cv::GaussianBlur(image, image, cv::Size(0, 0), sigma);
+        return;
+    }
+    if (sigma > MAX_FULL_SIZE_SIGMA) {
+        int factor = static_cast<int>(std::ceil(sigma / MAX_FULL_SIZE_SIGMA));
+        cv::Mat reduced;
+        cv::resize(image, reduced, cv::Size(std::max(1, image.cols / factor), std::max(1, image.rows / factor)), 0, 0,
+                   cv::INTER_AREA);
+        stackedBoxBlur(reduced, sigma / factor);
+        cv::resize(reduced, image, image.size(), 0, 0, cv::INTER_LINEAR);
+        return;
+    }
+
+    int widths[BOX_PASSES];
+    boxWidths(sigma, widths);
+    cv::Mat buffer(image.size(), image.type());
+    cv::parallel_for_(cv::Range(0, image.rows), [&](const cv::Range& rows) { blurRows(image, buffer, widths, rows); });
+    // Vertical passes alternate between the buffers and end in `image`.
+    blurColumns(buffer, image, widths[0]);
+    blurColumns(image, buffer, widths[1]);
+    blurColumns(buffer, image, widths[2]);
+}
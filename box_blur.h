@@ -0,0 +1,15 @@
+// box_blur.h
+#ifndef BOX_BLUR_H
+#define BOX_BLUR_H
+
+#include <opencv2/opencv.hpp>
+
+// Approximates cv::GaussianBlur(image, image, cv::Size(0, 0), sigma), in
+// place, with three stacked box blurs. Each box is a running sum, so a pixel
+// costs the same whatever the sigma. Takes 8-bit images with any number of
+// channels and uses GaussianBlur's reflected border. Large sigmas are
+// blurred at a reduced size, where the lost detail would be blurred away
+// anyway.
+void stackedBoxBlur(cv::Mat& image, double sigma);
+
+#endif // BOX_BLUR_H
@@ -0,0 +1,131 @@
+// chaosexplorerdialog.cpp
+#include "chaosexplorerdialog.h"
+#include "preview_frame_cache.h"
+#include <QHBoxLayout>
+#include <QVBoxLayout>
+#include <QLabel>
+#include <QIcon>
+#include <QPixmap>
+#include <QScrollArea>
+#include <QMetaObject>
+#include <QThread>
+#include <QtConcurrent>
+#include <cmath>
+#include <random>
+
+ChaosExplorerDialog::ChaosExplorerDialog(const GifSettings& base_settings, const cv::Mat& working_source, QWidget *parent)
+    : QDialog(parent), baseSettings(base_settings), selected(base_settings) {
+    setWindowTitle("Cosmic Chaos Explorer");
+    setMinimumSize(760, 640);
+    setModal(true);
+    renderPool.setMaxThreadCount(QThread::idealThreadCount());
+
+    // Scale the source down once; every thumbnail renders from this copy.
+    thumbnailPixelRatio = devicePixelRatioF();
+    int source_size = static_cast<int>(std::lround(THUMBNAIL_SIZE * thumbnailPixelRatio));
+    cv::resize(working_source, thumbnailSource, cv::Size(source_size, source_size), 0, 0, cv::INTER_AREA);
+    stageCache = std::make_shared<RenderStageCache>();
+
+    setupUi();
+    rollGrid();
+}
+
+ChaosExplorerDialog::~ChaosExplorerDialog() {
+    // Render tasks post their results back to this dialog.
+    renderPool.clear();
+    renderPool.waitForDone();
+}
+
+void ChaosExplorerDialog::setupUi() {
+    auto mainLayout = new QVBoxLayout(this);
+    mainLayout->setContentsMargins(20, 20, 20, 20);
+    mainLayout->setSpacing(15);
+
+    auto controlsLayout = new QHBoxLayout();
+    controlsLayout->addWidget(new QLabel("Configurations:"));
+    gridSizeCombo = new QComboBox();
+    for (int columns = 4; columns <= 8; ++columns) {
+        gridSizeCombo->addItem(QString::number(columns * columns), columns);
+    }
+    gridSizeCombo->setCurrentIndex(1);
+    controlsLayout->addWidget(gridSizeCombo);
+    rerollButton = new QPushButton("Reroll");
+    rerollButton->setObjectName("dialogButton");
+    controlsLayout->addWidget(rerollButton);
+    controlsLayout->addStretch(1);
+    mainLayout->addLayout(controlsLayout);
+
+    auto gridContainer = new QWidget();
+    gridLayout = new QGridLayout(gridContainer);
+    gridLayout->setSpacing(6);
+    auto scrollArea = new QScrollArea();
+    scrollArea->setWidgetResizable(true);
+    scrollArea->setWidget(gridContainer);
+    mainLayout->addWidget(scrollArea, 1);
+
+    auto dialogActionButtonsLayout = new QHBoxLayout();
+    dialogActionButtonsLayout->addWidget(new QLabel("Click a thumbnail to use its settings."));
+    dialogActionButtonsLayout->addStretch(1);
+    auto closeButton = new QPushButton("Close");
+    dialogActionButtonsLayout->addWidget(closeButton);
+    mainLayout->addLayout(dialogActionButtonsLayout);
+
+    connect(gridSizeCombo, QOverload<int>::of(&QComboBox::currentIndexChanged), this, &ChaosExplorerDialog::rollGrid);
+    connect(rerollButton, &QPushButton::clicked, this, &ChaosExplorerDialog::rollGrid);
+    connect(closeButton, &QPushButton::clicked, this, &ChaosExplorerDialog::reject);
+}
+
+void ChaosExplorerDialog::rollGrid() {
+    renderPool.clear();
+    ++generation;
+    qDeleteAll(cells);
+    cells.clear();
+
+    int columns = gridSizeCombo->currentData().toInt();
+    int count = columns * columns;
+    std::random_device rd;
+    std::mt19937 gen(rd());
+    candidates.clear();
+    for (int i = 0; i < count; ++i) {
+        candidates.push_back(GifSettings::randomized(baseSettings, gen));
+    }
+
+    FrameRenderOptions options;
+    options.min_layer_size = 1;
+    options.pixel_scale = static_cast<double>(thumbnailSource.cols) / GIF_WORKING_SIZE;
+
+    for (int i = 0; i < count; ++i) {
+        auto cell = new QPushButton();
+        cell->setFixedSize(THUMBNAIL_SIZE + 8, THUMBNAIL_SIZE + 8);
+        cell->setIconSize(QSize(THUMBNAIL_SIZE, THUMBNAIL_SIZE));
+        cell->setEnabled(false); // Until its thumbnail arrives
+        connect(cell, &QPushButton::clicked, this, [this, i]() { adoptCell(i); });
+        gridLayout->addWidget(cell, i / columns, i % columns);
+        cells.append(cell);
+
+        // cv::Mat is reference counted, so every renderer shares thumbnailSource.
+        GifSettings settings = candidates[i];
+        cv::Mat source = thumbnailSource;
+        std::shared_ptr<RenderStageCache> stages = stageCache;
+        qreal pixel_ratio = thumbnailPixelRatio;
+        quint64 roll = generation;
+        QtConcurrent::run(&renderPool, [this, settings, source, options, stages, pixel_ratio, roll, i]() {
+            FrameRenderer renderer(source, settings, options, stages);
+            QImage image = PreviewFrameCache::renderImage(renderer, settings.num_frames / 2, pixel_ratio);
+            QMetaObject::invokeMethod(this, [this, roll, i, image]() {
+                showThumbnail(roll, i, image);
+            }, Qt::QueuedConnection);
+        });
+    }
+}
+
+void ChaosExplorerDialog::showThumbnail(quint64 roll, int cell, const QImage& image) {
+    if (roll != generation || cell >= cells.size() || image.isNull()) return;
+    cells[cell]->setIcon(QIcon(QPixmap::fromImage(image)));
+    cells[cell]->setEnabled(true);
+}
+
+void ChaosExplorerDialog::adoptCell(int cell) {
+    selected = candidates[cell];
+    accept();
+}
@@ -0,0 +1,57 @@
+// chaosexplorerdialog.h
+#ifndef CHAOSEXPLORERDIALOG_H
+#define CHAOSEXPLORERDIALOG_H
+
+#include <QDialog>
+#include <QComboBox>
+#include <QPushButton>
+#include <QGridLayout>
+#include <QImage>
+#include <QList>
+#include <QThreadPool>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "gif_settings.h"
+#include "frame_renderer.h"
+
+// Shows a grid of random "Cosmic Chaos" configurations side by side. Each
+// thumbnail is rendered on its own pool thread from one shared, pre-scaled
+// copy of the source; clicking a thumbnail adopts its settings.
+class ChaosExplorerDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    // `working_source` is the decoded BGRA source at GIF resolution.
+    ChaosExplorerDialog(const GifSettings& base_settings, const cv::Mat& working_source, QWidget *parent = nullptr);
+    ~ChaosExplorerDialog() override;
+
+    const GifSettings& selectedSettings() const { return selected; }
+
+private slots:
+    void rollGrid();
+
+private:
+    static const int THUMBNAIL_SIZE = 128;
+
+    GifSettings baseSettings;
+    GifSettings selected;
+    cv::Mat thumbnailSource; // Shared read-only by every render task
+    std::shared_ptr<RenderStageCache> stageCache; // Layers and masks shared across thumbnails
+    qreal thumbnailPixelRatio = 1.0;
+    std::vector<GifSettings> candidates;
+    QThreadPool renderPool;
+    quint64 generation = 0; // Bumped on every reroll so stale thumbnails are dropped
+
+    // Widgets
+    QComboBox* gridSizeCombo;
+    QPushButton* rerollButton;
+    QGridLayout* gridLayout;
+    QList<QPushButton*> cells;
+
+    void setupUi();
+    void showThumbnail(quint64 roll, int cell, const QImage& image);
+    void adoptCell(int cell);
+};
+
+#endif // CHAOSEXPLORERDIALOG_H
@@ -0,0 +1,35 @@
+// counter_rng.h
+#ifndef COUNTER_RNG_H
+#define COUNTER_RNG_H
+
+#include <cstdint>
+
+// "Squares" counter-based random numbers (B. Widynski, 2020). The n-th
+// number for a key is computed directly from (n, key) with no generator
+// state, so any frame, star or thread can draw its numbers independently
+// and get the same values however the work is ordered.
+inline std::uint32_t squares32(std::uint64_t counter, std::uint64_t key) {
+    std::uint64_t x = counter * key;
+    std::uint64_t y = x;
+    std::uint64_t z = y + key;
+    x = x * x + y; x = (x >> 32) | (x << 32);
+    x = x * x + z; x = (x >> 32) | (x << 32);
+    x = x * x + y; x = (x >> 32) | (x << 32);
+    return static_cast<std::uint32_t>((x * x + z) >> 32);
+}
+
+// Turns a user seed into a Squares key. Squares wants keys with well mixed
+// bits, so the seed goes through the splitmix64 finalizer first.
+inline std::uint64_t squaresKey(std::uint64_t seed) {
+    std::uint64_t z = seed + 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return (z ^ (z >> 31)) | 1; // Odd, so counter * key never collapses to 0
+}
+
+// Maps a 32-bit random number onto [0, range) without division.
+inline int scaleToRange(std::uint32_t value, int range) {
+    return static_cast<int>((static_cast<std::uint64_t>(value) * static_cast<std::uint32_t>(range)) >> 32);
+}
+
+#endif // COUNTER_RNG_H
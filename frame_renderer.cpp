@@ -0,0 +1,1285 @@
+// frame_renderer.cpp
+#include "frame_renderer.h"
+#include "box_blur.h"
+#include "counter_rng.h"
+#include "stage_timer.h"
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <numeric>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+cv::Mat decodeSourceImage(const std::string& path) {
+    GIF_STAGE_TIMER("source_load");
+    cv::Mat original_image_bgr = cv::imread(path, cv::IMREAD_UNCHANGED);
+    if (original_image_bgr.empty()) {
+        return cv::Mat();
+    }
+
+    cv::Mat original_image_rgba;
+    if (original_image_bgr.channels() == 1) {
+        cv::cvtColor(original_image_bgr, original_image_rgba, cv::COLOR_GRAY2BGRA);
+    } else if (original_image_bgr.channels() < 4) {
+        cv::cvtColor(original_image_bgr, original_image_rgba, cv::COLOR_BGR2BGRA);
+    } else {
+        original_image_rgba = original_image_bgr;
+    }
+    return original_image_rgba;
+}
+
+cv::Mat loadSourceImage(const std::string& path, int size, int interpolation) {
+    cv::Mat original_image_rgba = decodeSourceImage(path);
+    if (original_image_rgba.empty()) {
+        return cv::Mat();
+    }
+
+    GIF_STAGE_TIMER("source_resize");
+    cv::Mat resized;
+    cv::resize(original_image_rgba, resized, cv::Size(size, size), 0, 0, interpolation);
+    return resized;
+}
+
+namespace {
+
+bool hasOpaqueAlpha(const cv::Mat& bgra) {
+    if (bgra.channels() != 4) return false;
+    cv::Mat alpha;
+    cv::extractChannel(bgra, alpha, 3);
+    double min_alpha = 0.0;
+    cv::minMaxLoc(alpha, &min_alpha);
+    return min_alpha >= 255.0;
+}
+
+// Narrows [first, last] to the x for which lo <= slope * x + offset <= hi.
+void clipToRange(double slope, double offset, double lo, double hi, double& first, double& last) {
+    if (std::abs(slope) < 1e-12) {
+        if (offset < lo || offset > hi) last = first - 1.0;
+        return;
+    }
+    double a = (lo - offset) / slope;
+    double b = (hi - offset) / slope;
+    first = std::max(first, std::min(a, b));
+    last = std::min(last, std::max(a, b));
+}
+
+// The share of a bilinear sample at `position` that falls inside [0, size - 1].
+double axisCoverage(double position, int size) {
+    return std::max(0.0, std::min(1.0, std::min(position + 1.0, size - position)));
+}
+
+// The sizes of the tunnel's layers, largest first: the source scaled by
+// successive powers of scale_decay until a layer is smaller than
+// min_layer_size.
+std::vector<cv::Size> layerSizes(cv::Size source, double scale_decay, int max_layers, int min_layer_size) {
+    std::vector<cv::Size> sizes;
+    double current_layer_scale = 1.0;
+    for (int layer = 0; layer < max_layers; ++layer) {
+        int scaled_width = static_cast<int>(source.width * current_layer_scale);
+        int scaled_height = static_cast<int>(source.height * current_layer_scale);
+        if (scaled_width < min_layer_size || scaled_height < min_layer_size) break;
+        sizes.push_back(cv::Size(scaled_width, scaled_height));
+        current_layer_scale *= scale_decay;
+    }
+    return sizes;
+}
+
+// Warps the box of `box_size` at (box_x, box_y) of a layer of `layer_size`
+// straight from a pyramid level: `inverse` maps frame-relative layer
+// coordinates to layer pixels, and is scaled here to the level's pixels.
+void warpFromMipLevel(const cv::Mat& level, const double* inverse, cv::Size layer_size, int box_x, int box_y,
+                      cv::Size box_size, int interpolation, int border_mode, cv::Mat& output) {
+    double scale_x = static_cast<double>(level.cols) / layer_size.width;
+    double scale_y = static_cast<double>(level.rows) / layer_size.height;
+    const double* m = inverse;
+    cv::Matx23d map(scale_x * m[0], scale_x * m[1], scale_x * (m[0] * box_x + m[1] * box_y + m[2] + 0.5) - 0.5,
+                    scale_y * m[3], scale_y * m[4], scale_y * (m[3] * box_x + m[4] * box_y + m[5] + 0.5) - 0.5);
+    cv::warpAffine(level, output, map, box_size, interpolation | cv::WARP_INVERSE_MAP, border_mode);
+}
+
+// Below this the coarser level would not change a pixel by a full step.
+const double MIN_LEVEL_BLEND = 1.0 / 512.0;
+
+// The finer of the two pyramid levels a layer of `size` samples, and the
+// weight of the next coarser one. Only bilinear sampling blends levels.
+void layerMipLevel(cv::Size source, cv::Size size, size_t coarsest_level, bool bilinear, size_t& level,
+                   double& level_blend) {
+    double lod = std::max(0.0, std::log2(std::max(static_cast<double>(source.width) / size.width,
+                                                  static_cast<double>(source.height) / size.height)));
+    level_blend = 0.0;
+    if (bilinear) {
+        level = std::min(static_cast<size_t>(lod), coarsest_level);
+        if (level < coarsest_level) level_blend = lod - level;
+    } else {
+        level = std::min(static_cast<size_t>(std::lround(lod)), coarsest_level);
+    }
+}
+
+// warpFromMipLevel() from `level`, blended with the next coarser level by
+// `level_blend`: trilinear filtering. `coarser` holds the second samples.
+void sampleLayerBox(const std::vector<cv::Mat>& pyramid, size_t level, double level_blend, const double* inverse,
+                    cv::Size layer_size, int box_x, int box_y, cv::Size box_size, int interpolation, int border_mode,
+                    cv::Mat& output, cv::Mat& coarser) {
+    if (level_blend > 1.0 - MIN_LEVEL_BLEND) { // Just the coarser level
+        ++level;
+        level_blend = 0.0;
+    }
+    warpFromMipLevel(pyramid[level], inverse, layer_size, box_x, box_y, box_size, interpolation, border_mode, output);
+    if (level_blend >= MIN_LEVEL_BLEND) {
+        warpFromMipLevel(pyramid[level + 1], inverse, layer_size, box_x, box_y, box_size, interpolation, border_mode,
+                         coarser);
+        cv::addWeighted(output, 1.0 - level_blend, coarser, level_blend, 0.0, output);
+    }
+}
+
+// Draws BGRA `layer` over BGRA `frame`, both with straight alpha.
+void drawStraightAlpha(const cv::Mat& layer, cv::Mat& frame) {
+    for (int r = 0; r < layer.rows; ++r) {
+        const uchar* src = layer.ptr<uchar>(r);
+        uchar* dst = frame.ptr<uchar>(r);
+        for (int c = 0; c < layer.cols; ++c, src += 4, dst += 4) {
+            int src_alpha = src[3];
+            if (src_alpha == 0) continue;
+            if (src_alpha == 255) {
+                std::memcpy(dst, src, 4);
+                continue;
+            }
+            // Weights out of 255 * 255.
+            int src_weight = src_alpha * 255;
+            int dst_weight = dst[3] * (255 - src_alpha);
+            int total = src_weight + dst_weight;
+            for (int k = 0; k < 3; ++k) {
+                dst[k] = static_cast<uchar>((src[k] * src_weight + dst[k] * dst_weight + total / 2) / total);
+            }
+            dst[3] = static_cast<uchar>((total + 127) / 255);
+        }
+    }
+}
+
+// Draws premultiplied BGRA `layer` over premultiplied BGRA `target`.
+void compositePremultiplied(const cv::Mat& layer, cv::Mat& target) {
+    for (int r = 0; r < layer.rows; ++r) {
+        const uchar* src = layer.ptr<uchar>(r);
+        uchar* dst = target.ptr<uchar>(r);
+        for (int c = 0; c < layer.cols; ++c, src += 4, dst += 4) {
+            int transparency = 255 - src[3];
+            if (transparency == 255) continue;
+            for (int k = 0; k < 4; ++k) {
+                dst[k] = static_cast<uchar>(std::min(255, src[k] + (dst[k] * transparency + 127) / 255));
+            }
+        }
+    }
+}
+
+// Draws premultiplied BGRA `layer` over a working frame: BGR, or BGRA with
+// straight alpha.
+void drawPremultiplied(const cv::Mat& layer, cv::Mat& frame) {
+    int channels = frame.channels();
+    for (int r = 0; r < layer.rows; ++r) {
+        const uchar* src = layer.ptr<uchar>(r);
+        uchar* dst = frame.ptr<uchar>(r);
+        for (int c = 0; c < layer.cols; ++c, src += 4, dst += channels) {
+            if (src[3] == 0) continue;
+            double transparency = 1.0 - src[3] / 255.0;
+            double frame_alpha = (channels == 4) ? dst[3] / 255.0 : 1.0;
+            double new_alpha = src[3] / 255.0 + frame_alpha * transparency;
+            for (int k = 0; k < 3; ++k) {
+                dst[k] = cv::saturate_cast<uchar>((src[k] + dst[k] * frame_alpha * transparency) / new_alpha);
+            }
+            if (channels == 4) dst[3] = cv::saturate_cast<uchar>(new_alpha * 255);
+        }
+    }
+}
+
+// Draws the premultiplied `stack` over `target`, both frame-sized, scaled by
+// `scale` and turned by `angle_degrees` about the frame centre. Only the box
+// the shrunken stack lands in is warped and blended. A stack shrunk below
+// half size is first area-averaged to about its final size, since a
+// bilinear warp alone would alias. `stack` may be `target`.
+void nestStack(const cv::Mat& stack, double angle_degrees, double scale, int interpolation, cv::Mat& target) {
+    cv::Mat forward = cv::getRotationMatrix2D(cv::Point2f(target.cols / 2.0F, target.rows / 2.0F), angle_degrees, scale);
+    cv::Mat source = stack;
+    if (scale < 0.5) {
+        cv::resize(stack, source, cv::Size(std::max(1, static_cast<int>(std::lround(stack.cols * scale))),
+                                           std::max(1, static_cast<int>(std::lround(stack.rows * scale)))),
+                   0, 0, cv::INTER_AREA);
+        // Stack pixel p is resized pixel q at p = step * (q + 0.5) - 0.5.
+        double step_x = static_cast<double>(stack.cols) / source.cols;
+        double step_y = static_cast<double>(stack.rows) / source.rows;
+        double* f = forward.ptr<double>();
+        for (int row = 0; row < 2; ++row, f += 3) {
+            f[2] += f[0] * (0.5 * step_x - 0.5) + f[1] * (0.5 * step_y - 0.5);
+            f[0] *= step_x;
+            f[1] *= step_y;
+        }
+    }
+
+    const double* f = forward.ptr<double>();
+    double min_x = target.cols, min_y = target.rows, max_x = 0.0, max_y = 0.0;
+    for (double x : {-0.5, source.cols - 0.5}) {
+        for (double y : {-0.5, source.rows - 0.5}) {
+            double frame_x = f[0] * x + f[1] * y + f[2];
+            double frame_y = f[3] * x + f[4] * y + f[5];
+            min_x = std::min(min_x, frame_x); max_x = std::max(max_x, frame_x);
+            min_y = std::min(min_y, frame_y); max_y = std::max(max_y, frame_y);
+        }
+    }
+    int box_x = static_cast<int>(std::floor(min_x)) - 1;
+    int box_y = static_cast<int>(std::floor(min_y)) - 1;
+    cv::Rect box = cv::Rect(box_x, box_y, static_cast<int>(std::ceil(max_x)) + 2 - box_x, static_cast<int>(std::ceil(max_y)) + 2 - box_y) &
+                   cv::Rect(0, 0, target.cols, target.rows);
+    if (box.empty()) return;
+
+    forward.at<double>(0, 2) -= box.x;
+    forward.at<double>(1, 2) -= box.y;
+    cv::Mat warped;
+    cv::warpAffine(source, warped, forward, box.size(), interpolation, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    cv::Mat target_box = target(box);
+    compositePremultiplied(warped, target_box);
+}
+
+// Rows per band of hexagonal pixelation, at least, so each band's sums
+// cost little next to the pixels it reads.
+const int MIN_CELL_BAND_ROWS = 32;
+
+// Replaces each block_width x block_height block of `frame` with its mean
+// colour; blocks cut off by the right and bottom edges average the pixels
+// they have. A band of blocks is summed and written back while it is still
+// in cache, and bands run in parallel.
+template <int Channels>
+void averageBlocks(cv::Mat& frame, int block_width, int block_height) {
+    int num_blocks = (frame.cols + block_width - 1) / block_width;
+    int num_bands = (frame.rows + block_height - 1) / block_height;
+    cv::parallel_for_(cv::Range(0, num_bands), [&](const cv::Range& bands) {
+        std::vector<unsigned> sums(num_blocks * Channels);
+        std::vector<uchar> means(num_blocks * Channels);
+        for (int band = bands.start; band < bands.end; ++band) {
+            int first_row = band * block_height;
+            int end_row = std::min(frame.rows, first_row + block_height);
+            std::fill(sums.begin(), sums.end(), 0u);
+            for (int r = first_row; r < end_row; ++r) {
+                const uchar* pixel = frame.ptr<uchar>(r);
+                for (int b = 0; b < num_blocks; ++b) {
+                    unsigned* block_sums = &sums[b * Channels];
+                    int block_cols = std::min(block_width, frame.cols - b * block_width);
+                    for (int c = 0; c < block_cols; ++c, pixel += Channels) {
+                        for (int k = 0; k < Channels; ++k) block_sums[k] += pixel[k];
+                    }
+                }
+            }
+            for (int b = 0; b < num_blocks; ++b) {
+                unsigned count = static_cast<unsigned>(std::min(block_width, frame.cols - b * block_width) * (end_row - first_row));
+                for (int k = 0; k < Channels; ++k) {
+                    means[b * Channels + k] = static_cast<uchar>((sums[b * Channels + k] + count / 2) / count);
+                }
+            }
+            for (int r = first_row; r < end_row; ++r) {
+                uchar* pixel = frame.ptr<uchar>(r);
+                for (int b = 0; b < num_blocks; ++b) {
+                    const uchar* mean = &means[b * Channels];
+                    int block_cols = std::min(block_width, frame.cols - b * block_width);
+                    for (int c = 0; c < block_cols; ++c, pixel += Channels) {
+                        for (int k = 0; k < Channels; ++k) pixel[k] = mean[k];
+                    }
+                }
+            }
+        }
+    });
+}
+
+// Replaces every pixel with the mean colour of its cell. Bands of rows are
+// summed in parallel, each into sums of its own, which are merged before
+// the bands write the means back.
+template <int Channels>
+void averageCells(cv::Mat& frame, const HexCellMap& cells) {
+    size_t num_sums = cells.cell_sizes.size() * Channels;
+    int num_bands = std::max(1, std::min(cv::getNumThreads(), frame.rows / MIN_CELL_BAND_ROWS));
+    auto band_rows = [&](int band) {
+        return cv::Range(band * frame.rows / num_bands, (band + 1) * frame.rows / num_bands);
+    };
+
+    std::vector<std::vector<unsigned>> band_sums(num_bands);
+    cv::parallel_for_(cv::Range(0, num_bands), [&](const cv::Range& bands) {
+        for (int band = bands.start; band < bands.end; ++band) {
+            std::vector<unsigned>& sums = band_sums[band];
+            sums.assign(num_sums, 0u);
+            cv::Range rows = band_rows(band);
+            for (int r = rows.start; r < rows.end; ++r) {
+                const uchar* pixel = frame.ptr<uchar>(r);
+                const int* cell = cells.cell_ids.ptr<int>(r);
+                for (int c = 0; c < frame.cols; ++c, pixel += Channels) {
+                    unsigned* cell_sums = &sums[cell[c] * Channels];
+                    for (int k = 0; k < Channels; ++k) cell_sums[k] += pixel[k];
+                }
+            }
+        }
+    });
+
+    std::vector<uchar> means(num_sums);
+    for (size_t i = 0; i < cells.cell_sizes.size(); ++i) {
+        unsigned count = static_cast<unsigned>(std::max(1, cells.cell_sizes[i]));
+        for (int k = 0; k < Channels; ++k) {
+            unsigned sum = 0;
+            for (const std::vector<unsigned>& sums : band_sums) sum += sums[i * Channels + k];
+            means[i * Channels + k] = static_cast<uchar>((sum + count / 2) / count);
+        }
+    }
+
+    cv::parallel_for_(cv::Range(0, num_bands), [&](const cv::Range& bands) {
+        for (int band = bands.start; band < bands.end; ++band) {
+            cv::Range rows = band_rows(band);
+            for (int r = rows.start; r < rows.end; ++r) {
+                uchar* pixel = frame.ptr<uchar>(r);
+                const int* cell = cells.cell_ids.ptr<int>(r);
+                for (int c = 0; c < frame.cols; ++c, pixel += Channels) {
+                    const uchar* mean = &means[cell[c] * Channels];
+                    for (int k = 0; k < Channels; ++k) pixel[k] = mean[k];
+                }
+            }
+        }
+    });
+}
+
+// Frame angles are taken to one turn and rounded to this step, so frames a
+// whole number of turns apart draw exactly the same tunnel.
+const double ANGLE_STEPS_PER_DEGREE = 4096.0;
+
+// Rows of a layer are warped in bands of this many rows, each boxed around
+// its visible pixels; boxes closer than the gap are warped as one.
+const int LAYER_BAND_ROWS = 16;
+const int LAYER_BOX_MIN_GAP = 32;
+
+// Columns [begin, end) of a row.
+struct ColumnSpan {
+    int begin = 0;
+    int end = 0;
+
+    bool empty() const { return end <= begin; }
+    void extend(const ColumnSpan& other) {
+        if (other.empty()) return;
+        if (empty()) {
+            *this = other;
+        } else {
+            begin = std::min(begin, other.begin);
+            end = std::max(end, other.end);
+        }
+    }
+};
+
+// One row of an opaque layer, in the layer's own columns.
+struct LayerRowSpans {
+    ColumnSpan edge;   // Touched by the layer
+    ColumnSpan full;   // Fully covered by it
+    ColumnSpan hidden; // Fully covered by nearer layers
+};
+
+struct LayerPlan {
+    cv::Rect roi;
+    cv::Mat inverse; // Frame-to-layer map, as warpAffine samples it
+    size_t level = 0; // Finer of the two pyramid levels sampled
+    double level_blend = 0.0; // Weight of the next, coarser level
+    int first_row = 0;
+    std::vector<LayerRowSpans> rows;
+    bool visible = false;
+};
+
+// The parts of the row's edge span that nearer layers leave visible: left
+// and right of the hidden span, or the whole span in the first entry.
+void visibleSegments(const LayerRowSpans& spans, ColumnSpan segments[2]) {
+    const ColumnSpan& edge = spans.edge;
+    const ColumnSpan& hidden = spans.hidden;
+    if (hidden.empty() || hidden.end <= edge.begin || hidden.begin >= edge.end) {
+        segments[0] = edge;
+        segments[1] = ColumnSpan();
+        return;
+    }
+    segments[0] = ColumnSpan{edge.begin, std::min(edge.end, hidden.begin)};
+    segments[1] = ColumnSpan{std::max(edge.begin, hidden.end), edge.end};
+}
+
+// Both spans if they touch; otherwise the longer one, which keeps the
+// result a subset of the covered columns.
+ColumnSpan coveredUnion(const ColumnSpan& a, const ColumnSpan& b) {
+    if (a.empty()) return b;
+    if (b.empty()) return a;
+    if (b.begin <= a.end && a.begin <= b.end) {
+        return ColumnSpan{std::min(a.begin, b.begin), std::max(a.end, b.end)};
+    }
+    return (b.end - b.begin > a.end - a.begin) ? b : a;
+}
+
+const std::uint64_t FNV_OFFSET_BASIS = 14695981039346656037ULL;
+const std::uint64_t FNV_PRIME = 1099511628211ULL;
+
+std::uint64_t fnv1a(std::uint64_t hash, const uchar* data, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        hash = (hash ^ data[i]) * FNV_PRIME;
+    }
+    return hash;
+}
+
+std::uint64_t fnv1a(std::uint64_t hash, std::uint64_t value) {
+    for (int i = 0; i < 8; ++i) {
+        hash = (hash ^ ((value >> (8 * i)) & 0xFF)) * FNV_PRIME;
+    }
+    return hash;
+}
+
+} // namespace
+
+PreparedSource prepareSource(const std::string& path, int preview_size) {
+    PreparedSource prepared;
+    prepared.path = path;
+    prepared.working = loadSourceImage(path, GIF_WORKING_SIZE, cv::INTER_LANCZOS4);
+    if (prepared.working.empty()) return prepared;
+    if (preview_size > 0) {
+        cv::resize(prepared.working, prepared.preview, cv::Size(preview_size, preview_size), 0, 0, cv::INTER_AREA);
+    }
+
+    // GifWorker renders with the default options, which take opaque sources
+    // to BGR before building their pyramid.
+    prepared.stages = std::make_shared<RenderStageCache>();
+    cv::Mat layer_source = prepared.working;
+    if (hasOpaqueAlpha(layer_source)) {
+        cv::cvtColor(layer_source, layer_source, cv::COLOR_BGRA2BGR);
+    }
+    prepared.stages->mipPyramid(path, layer_source);
+    return prepared;
+}
+
+std::uint64_t frameChecksum(const cv::Mat& frame) {
+    std::uint64_t hash = FNV_OFFSET_BASIS;
+    hash = fnv1a(hash, static_cast<std::uint64_t>(frame.cols));
+    hash = fnv1a(hash, static_cast<std::uint64_t>(frame.rows));
+    hash = fnv1a(hash, static_cast<std::uint64_t>(frame.type()));
+    size_t row_bytes = frame.cols * frame.elemSize();
+    for (int r = 0; r < frame.rows; ++r) {
+        hash = fnv1a(hash, frame.ptr<uchar>(r), row_bytes); // Row by row, so padding is skipped
+    }
+    return hash;
+}
+
+std::uint64_t combineChecksums(const std::vector<std::uint64_t>& checksums) {
+    std::uint64_t hash = FNV_OFFSET_BASIS;
+    for (std::uint64_t checksum : checksums) {
+        hash = fnv1a(hash, checksum);
+    }
+    return hash;
+}
+
+size_t tunnelCompositeBytes(const GifSettings& settings, cv::Size size) {
+    if (settings.num_frames <= 0) return 0;
+    int turns = 0;
+    if (settings.rotation_direction != RotationDirection::None) {
+        turns = static_cast<int>(std::abs(std::round(settings.rotation_speed / 2.0)));
+    }
+    // Frames this far apart are a whole number of turns apart.
+    int period = settings.num_frames / std::gcd(settings.num_frames, turns);
+    size_t bytes = static_cast<size_t>(period) * size.width * size.height * 4;
+    return (period < settings.num_frames && bytes <= RenderStageCache::MAX_TUNNEL_BYTES) ? bytes : 0;
+}
+
+const char* frameStageName(FrameStage stage) {
+    switch (stage) {
+    case FrameStage::Starfield: return "starfield";
+    case FrameStage::Layers: return "layers";
+    case FrameStage::Vignette: return "vignette";
+    case FrameStage::GlobalZoom: return "global_zoom";
+    case FrameStage::Pixelation: return "pixelation";
+    case FrameStage::Wave: return "wave";
+    case FrameStage::Geometry: return "geometry";
+    case FrameStage::HuePulse: return "hue_pulse";
+    case FrameStage::ColorInvert: return "color_invert";
+    case FrameStage::Blur: return "blur";
+    }
+    return "unknown";
+}
+
+template <typename Value>
+struct RenderStageCache::Entry {
+    std::once_flag computed;
+    Value value;
+};
+
+namespace {
+
+// Finds or inserts the entry for `key` under the lock, then computes it
+// outside the lock, so different stages are built in parallel while
+// callers asking for the same one wait for the single computation.
+template <typename Key, typename Value, typename Compute>
+std::shared_ptr<const Value> lookupStage(std::mutex& mutex,
+                                         std::map<Key, std::shared_ptr<RenderStageCache::Entry<Value>>>& table,
+                                         std::deque<Key>& order, size_t max_entries,
+                                         const Key& key, Compute compute) {
+    std::shared_ptr<RenderStageCache::Entry<Value>> entry;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = table.find(key);
+        if (it != table.end()) {
+            entry = it->second;
+        } else {
+            entry = std::make_shared<RenderStageCache::Entry<Value>>();
+            table.emplace(key, entry);
+            order.push_back(key);
+            if (order.size() > max_entries) {
+                table.erase(order.front()); // Renderers still using it keep their reference
+                order.pop_front();
+            }
+        }
+    }
+    std::call_once(entry->computed, [&]() { compute(entry->value); });
+    return std::shared_ptr<const Value>(entry, &entry->value);
+}
+
+} // namespace
+
+std::shared_ptr<const std::vector<cv::Mat>> RenderStageCache::mipPyramid(const std::string& source_id,
+                                                                         const cv::Mat& source) {
+    PyramidKey key(source_id, source.cols, source.rows, source.type());
+    return lookupStage(m_mutex, m_pyramids, m_pyramid_order, MAX_ENTRIES, key, [&](std::vector<cv::Mat>& pyramid) {
+        pyramid.push_back(source);
+        while (pyramid.back().cols > 1 && pyramid.back().rows > 1) {
+            cv::Mat next_level;
+            cv::pyrDown(pyramid.back(), next_level);
+            pyramid.push_back(next_level);
+        }
+    });
+}
+
+std::shared_ptr<const cv::Mat> RenderStageCache::tunnelComposite(const TunnelKey& key,
+                                                                 const std::function<void(cv::Mat&)>& render) {
+    size_t composite_bytes = static_cast<size_t>(std::get<1>(key)) * std::get<2>(key) * 4;
+    size_t max_entries = std::max<size_t>(1, MAX_TUNNEL_BYTES / std::max<size_t>(1, composite_bytes));
+    return lookupStage(m_mutex, m_tunnels, m_tunnel_order, max_entries, key, render);
+}
+
+void RenderStageCache::trimTunnels(size_t max_bytes) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    size_t total_bytes = 0;
+    for (const TunnelKey& key : m_tunnel_order) {
+        total_bytes += static_cast<size_t>(std::get<1>(key)) * std::get<2>(key) * 4;
+    }
+    while (total_bytes > max_bytes && !m_tunnel_order.empty()) {
+        const TunnelKey& oldest = m_tunnel_order.front();
+        total_bytes -= static_cast<size_t>(std::get<1>(oldest)) * std::get<2>(oldest) * 4;
+        m_tunnels.erase(oldest); // Renderers still using it keep their reference
+        m_tunnel_order.pop_front();
+    }
+}
+
+std::shared_ptr<const HexCellMap> RenderStageCache::hexCells(cv::Size size, int cell_width) {
+    HexKey key(size.width, size.height, cell_width);
+    return lookupStage(m_mutex, m_hex_cells, m_hex_order, MAX_ENTRIES, key, [&](HexCellMap& cells) {
+        // Rounds each pixel centre to its hexagon in cube coordinates, then
+        // numbers the hexagons by their offset row and column.
+        double radius = cell_width / std::sqrt(3.0);
+        cv::Mat rows(size, CV_32SC1), cols(size, CV_32SC1);
+        int min_row = INT_MAX, max_row = INT_MIN, min_col = INT_MAX, max_col = INT_MIN;
+        for (int y = 0; y < size.height; ++y) {
+            int* row_out = rows.ptr<int>(y);
+            int* col_out = cols.ptr<int>(y);
+            for (int x = 0; x < size.width; ++x) {
+                double q = (std::sqrt(3.0) / 3.0 * (x + 0.5) - (y + 0.5) / 3.0) / radius;
+                double r = (2.0 / 3.0 * (y + 0.5)) / radius;
+                double s = -q - r;
+                double rounded_q = std::round(q), rounded_r = std::round(r), rounded_s = std::round(s);
+                double dq = std::abs(rounded_q - q), dr = std::abs(rounded_r - r), ds = std::abs(rounded_s - s);
+                if (dq > dr && dq > ds) {
+                    rounded_q = -rounded_r - rounded_s;
+                } else if (dr > ds) {
+                    rounded_r = -rounded_q - rounded_s;
+                }
+                int hex_row = static_cast<int>(rounded_r);
+                int hex_col = static_cast<int>(rounded_q) + (hex_row - (hex_row & 1)) / 2;
+                row_out[x] = hex_row;
+                col_out[x] = hex_col;
+                min_row = std::min(min_row, hex_row); max_row = std::max(max_row, hex_row);
+                min_col = std::min(min_col, hex_col); max_col = std::max(max_col, hex_col);
+            }
+        }
+        int num_cols = max_col - min_col + 1;
+        cells.cell_ids.create(size, CV_32SC1);
+        cells.cell_sizes.assign(static_cast<size_t>(max_row - min_row + 1) * num_cols, 0);
+        for (int y = 0; y < size.height; ++y) {
+            const int* row_in = rows.ptr<int>(y);
+            const int* col_in = cols.ptr<int>(y);
+            int* id_out = cells.cell_ids.ptr<int>(y);
+            for (int x = 0; x < size.width; ++x) {
+                id_out[x] = (row_in[x] - min_row) * num_cols + (col_in[x] - min_col);
+                ++cells.cell_sizes[id_out[x]];
+            }
+        }
+    });
+}
+
+std::shared_ptr<const cv::Mat> RenderStageCache::vignetteMask(cv::Size size, double strength) {
+    VignetteKey key(size.width, size.height, strength);
+    return lookupStage(m_mutex, m_vignettes, m_vignette_order, MAX_ENTRIES, key, [&](cv::Mat& vignette_mask) {
+        vignette_mask.create(size.height, size.width, CV_32FC1);
+        cv::Point2f center(size.width / 2.0F, size.height / 2.0F);
+        double max_dist = std::sqrt(center.x * center.x + center.y * center.y);
+
+        for (int r = 0; r < size.height; ++r) {
+            for (int c = 0; c < size.width; ++c) {
+                double dist = cv::norm(cv::Point2f(c, r) - center);
+                double normalized_dist = dist / max_dist;
+                // Apply a power function to the normalized distance for a smoother falloff
+                double vignette_value = 1.0 - strength * std::pow(normalized_dist, 2.0);
+                vignette_mask.at<float>(r, c) = static_cast<float>(std::max(0.0, std::min(1.0, vignette_value)));
+            }
+        }
+    });
+}
+
+FrameRenderer::FrameRenderer(const cv::Mat& source_bgra, const GifSettings& settings,
+                             const FrameRenderOptions& options, std::shared_ptr<RenderStageCache> stage_cache)
+    : m_source(source_bgra), m_settings(settings), m_options(options), m_stages(std::move(stage_cache)) {
+    if (!m_stages) {
+        m_stages = std::make_shared<RenderStageCache>();
+    }
+    double num_rotations = std::round(m_settings.rotation_speed / 2.0);
+    double total_rotation_degrees = num_rotations * 360.0;
+
+    if (m_settings.rotation_direction == RotationDirection::CounterClockwise) {
+        total_rotation_degrees *= -1.0;
+    } else if (m_settings.rotation_direction == RotationDirection::None) {
+        total_rotation_degrees = 0.0;
+    }
+
+    m_angle_per_frame = (m_settings.num_frames > 0) ? (total_rotation_degrees / m_settings.num_frames) : 0.0;
+    m_star_key = squaresKey(static_cast<std::uint32_t>(m_settings.seed));
+
+    // Opaque layers only need the geometric edge blending for the sampling
+    // modes it models.
+    bool geometric_edges = m_options.warp_interpolation == cv::INTER_LINEAR ||
+                           m_options.warp_interpolation == cv::INTER_NEAREST;
+    if (geometric_edges && hasOpaqueAlpha(m_source)) {
+        cv::cvtColor(m_source, m_source, cv::COLOR_BGRA2BGR);
+        m_opaque = true;
+    }
+    if (m_settings.tunnel_mode == TunnelMode::Feedback) {
+        cv::cvtColor(m_source, m_feedback_source, m_opaque ? cv::COLOR_BGR2BGRA : cv::COLOR_RGBA2mRGBA);
+    }
+    buildPipeline();
+}
+
+cv::Mat FrameRenderer::blankFrame() const {
+    return cv::Mat::zeros(height(), width(), m_opaque ? CV_8UC3 : CV_8UC4);
+}
+
+void FrameRenderer::buildPipeline() {
+    auto add = [this](FrameStage stage, StageKernel kernel) { m_pipeline.push_back(PipelineStage{stage, kernel}); };
+
+    if (m_settings.num_stars > 0) {
+        switch (m_settings.advanced_starfield_pattern) {
+        case StarfieldPattern::Random: add(FrameStage::Starfield, &FrameRenderer::drawStarfield<StarfieldPattern::Random>); break;
+        case StarfieldPattern::Spiral: add(FrameStage::Starfield, &FrameRenderer::drawStarfield<StarfieldPattern::Spiral>); break;
+        case StarfieldPattern::None: break;
+        }
+    }
+    if (m_settings.tunnel_mode == TunnelMode::Feedback) {
+        m_layer_kernel = &FrameRenderer::compositeFeedbackTunnel;
+    } else {
+        m_layer_kernel = m_opaque ? &FrameRenderer::compositeOpaqueLayers : &FrameRenderer::compositeLayers;
+    }
+    // Renderers sharing the stage cache, such as the variants of a sweep,
+    // share the composites too. Whether they are used depends only on the
+    // settings, so a frame's pixels do not depend on who rendered it.
+    if (tunnelCompositeBytes(m_settings, m_source.size()) > 0) {
+        add(FrameStage::Layers, &FrameRenderer::drawCachedTunnel);
+    } else {
+        add(FrameStage::Layers, m_layer_kernel);
+    }
+    if (m_settings.vignette_strength > 0.0) {
+        add(FrameStage::Vignette, &FrameRenderer::applyVignette);
+    }
+    bool pixelation = pixelationLevel() > 1;
+    bool wave = m_settings.wave_amplitude > 0.0 && m_settings.wave_frequency > 0.0 &&
+                m_settings.wave_direction != WaveDirection::None;
+    bool horizontal = m_settings.wave_direction == WaveDirection::Horizontal;
+    if (wave && !pixelation && m_settings.global_zoom_mode != GlobalZoomMode::None) {
+        // Nothing runs between the zoom and the wave, so the frame is
+        // resampled once through both.
+        if (m_settings.global_zoom_mode == GlobalZoomMode::Linear) {
+            add(FrameStage::Geometry, horizontal ? &FrameRenderer::applyGeometry<GlobalZoomMode::Linear, WaveDirection::Horizontal>
+                                                 : &FrameRenderer::applyGeometry<GlobalZoomMode::Linear, WaveDirection::Vertical>);
+        } else {
+            add(FrameStage::Geometry, horizontal ? &FrameRenderer::applyGeometry<GlobalZoomMode::Oscillating, WaveDirection::Horizontal>
+                                                 : &FrameRenderer::applyGeometry<GlobalZoomMode::Oscillating, WaveDirection::Vertical>);
+        }
+    } else {
+        switch (m_settings.global_zoom_mode) {
+        case GlobalZoomMode::Linear: add(FrameStage::GlobalZoom, &FrameRenderer::applyGlobalZoom<GlobalZoomMode::Linear>); break;
+        case GlobalZoomMode::Oscillating: add(FrameStage::GlobalZoom, &FrameRenderer::applyGlobalZoom<GlobalZoomMode::Oscillating>); break;
+        case GlobalZoomMode::None: break;
+        }
+        if (pixelation) {
+            switch (m_settings.pixelation_shape) {
+            case PixelationShape::Square: add(FrameStage::Pixelation, &FrameRenderer::applyPixelation<PixelationShape::Square>); break;
+            case PixelationShape::Wide: add(FrameStage::Pixelation, &FrameRenderer::applyPixelation<PixelationShape::Wide>); break;
+            case PixelationShape::Tall: add(FrameStage::Pixelation, &FrameRenderer::applyPixelation<PixelationShape::Tall>); break;
+            case PixelationShape::Hexagon: add(FrameStage::Pixelation, &FrameRenderer::applyPixelation<PixelationShape::Hexagon>); break;
+            }
+        }
+        if (wave) {
+            add(FrameStage::Wave, horizontal ? &FrameRenderer::applyGeometry<GlobalZoomMode::None, WaveDirection::Horizontal>
+                                             : &FrameRenderer::applyGeometry<GlobalZoomMode::None, WaveDirection::Vertical>);
+        }
+    }
+    if (m_settings.hue_speed > 0 && m_settings.hue_intensity > 0) {
+        add(FrameStage::HuePulse, &FrameRenderer::applyHuePulse);
+    }
+    if (m_settings.color_invert_frequency > 0) {
+        add(FrameStage::ColorInvert, &FrameRenderer::applyColorInvert);
+    }
+    if (m_settings.blur_radius * m_options.pixel_scale > 0) {
+        add(FrameStage::Blur, &FrameRenderer::applyBlur);
+    }
+}
+
+void FrameRenderer::renderFrame(int frame_index, cv::Mat& output, FrameOutputFormat format) const {
+    cv::Mat frame = blankFrame();
+    double frame_progress = (m_settings.num_frames > 0) ? static_cast<double>(frame_index) / m_settings.num_frames : 0.0;
+
+    for (const PipelineStage& stage : m_pipeline) {
+        (this->*stage.kernel)(frame, frame_index, frame_progress);
+    }
+    writeOutput(frame, output, format);
+}
+
+void FrameRenderer::applyStage(FrameStage stage, cv::Mat& frame, int frame_index) const {
+    double frame_progress = (m_settings.num_frames > 0) ? static_cast<double>(frame_index) / m_settings.num_frames : 0.0;
+    for (const PipelineStage& enabled : m_pipeline) {
+        if (enabled.stage == stage) (this->*enabled.kernel)(frame, frame_index, frame_progress);
+    }
+}
+
+template <StarfieldPattern Pattern>
+void FrameRenderer::drawStarfield(cv::Mat& frame, int frame_index, double) const {
+    GIF_STAGE_TIMER("starfield");
+
+    int width = frame.cols;
+    int height = frame.rows;
+
+    if constexpr (Pattern == StarfieldPattern::Random) {
+        // Star s of frame f takes draws 2s and 2s+1 of stream f, so every
+        // frame's stars are independent of the frames rendered before it.
+        // Positions are computed in one branch-free pass before drawing.
+        std::uint64_t stream = static_cast<std::uint64_t>(frame_index) << 32;
+        std::vector<cv::Point> stars(m_settings.num_stars);
+        for (int s = 0; s < m_settings.num_stars; ++s) {
+            std::uint64_t counter = stream | (static_cast<std::uint64_t>(s) << 1);
+            stars[s].x = scaleToRange(squares32(counter, m_star_key), width);
+            stars[s].y = scaleToRange(squares32(counter | 1, m_star_key), height);
+        }
+        for (const cv::Point& star : stars) {
+            cv::circle(frame, star, 1, cv::Scalar(255, 255, 255, 255), cv::FILLED);
+        }
+    } else {
+        for (int j = 0; j < m_settings.num_stars; ++j) {
+            double angle = (0.1 * j) + (frame_index * 0.05);
+            double radius = 2 * j * m_options.pixel_scale;
+            int x = static_cast<int>(width / 2.0 + radius * std::cos(angle));
+            int y = static_cast<int>(height / 2.0 + radius * std::sin(angle));
+            if (x >= 0 && x < width && y >= 0 && y < height) {
+                cv::circle(frame, cv::Point(x, y), 1, cv::Scalar(255, 255, 255, 255), cv::FILLED);
+            }
+        }
+    }
+}
+
+int FrameRenderer::maxLayers() const {
+    int max_layers = m_settings.max_layers;
+    if (m_options.layer_limit > 0) {
+        max_layers = std::min(max_layers, m_options.layer_limit);
+    }
+    return max_layers;
+}
+
+double FrameRenderer::layerAngle(int frame_index) const {
+    const long long steps_per_turn = static_cast<long long>(360.0 * ANGLE_STEPS_PER_DEGREE);
+    long long steps = std::llround(m_angle_per_frame * frame_index * ANGLE_STEPS_PER_DEGREE) % steps_per_turn;
+    if (steps < 0) steps += steps_per_turn;
+    return steps / ANGLE_STEPS_PER_DEGREE;
+}
+
+// Translucent layers cannot hide the ones behind them, so each is drawn
+// whole, back to front. Like the opaque path, a layer is sampled straight
+// from the mip pyramid with trilinear filtering, and only over the box its
+// rotated square covers within the frame.
+void FrameRenderer::compositeLayers(cv::Mat& frame, int frame_index, double) const {
+    GIF_STAGE_TIMER("layers");
+    std::shared_ptr<const std::vector<cv::Mat>> pyramid = m_stages->mipPyramid(m_settings.image_path, m_source);
+    std::vector<cv::Size> sizes = layerSizes(m_source.size(), m_settings.scale_decay, maxLayers(), m_options.min_layer_size);
+    bool bilinear = m_options.warp_interpolation == cv::INTER_LINEAR;
+    double angle_degrees = layerAngle(frame_index);
+    size_t coarsest_level = pyramid->size() - 1;
+    cv::Rect frame_rect(0, 0, frame.cols, frame.rows);
+
+    cv::Mat rotated_box, coarser_box;
+    for (const cv::Size& size : sizes) {
+        cv::Rect roi((frame.cols / 2) - (size.width / 2), (frame.rows / 2) - (size.height / 2), size.width, size.height);
+        cv::Point2f center(size.width / 2.0F, size.height / 2.0F);
+        cv::Mat rotation = cv::getRotationMatrix2D(center, angle_degrees, 1.0);
+
+        // Bounds of the turned layer, one pixel wider for the samples that
+        // straddle its edge, within its own square.
+        const double* f = rotation.ptr<double>();
+        double min_x = size.width, max_x = 0.0, min_y = size.height, max_y = 0.0;
+        for (double corner_y : {-1.0, static_cast<double>(size.height)}) {
+            for (double corner_x : {-1.0, static_cast<double>(size.width)}) {
+                double x = f[0] * corner_x + f[1] * corner_y + f[2];
+                double y = f[3] * corner_x + f[4] * corner_y + f[5];
+                min_x = std::min(min_x, x); max_x = std::max(max_x, x);
+                min_y = std::min(min_y, y); max_y = std::max(max_y, y);
+            }
+        }
+        int box_left = std::max(0, static_cast<int>(std::floor(min_x)));
+        int box_top = std::max(0, static_cast<int>(std::floor(min_y)));
+        int box_right = std::min(size.width, static_cast<int>(std::ceil(max_x)) + 1);
+        int box_bottom = std::min(size.height, static_cast<int>(std::ceil(max_y)) + 1);
+        cv::Rect box = cv::Rect(roi.x + box_left, roi.y + box_top, box_right - box_left, box_bottom - box_top) & frame_rect;
+        if (box.empty()) continue;
+
+        cv::Mat inverse;
+        cv::invertAffineTransform(rotation, inverse);
+        size_t level = 0;
+        double level_blend = 0.0;
+        layerMipLevel(m_source.size(), size, coarsest_level, bilinear, level, level_blend);
+        sampleLayerBox(*pyramid, level, level_blend, inverse.ptr<double>(), size, box.x - roi.x, box.y - roi.y,
+                       box.size(), m_options.warp_interpolation, cv::BORDER_CONSTANT, rotated_box, coarser_box);
+        cv::Mat frame_box = frame(box);
+        drawStraightAlpha(rotated_box, frame_box);
+    }
+}
+
+// Plans the layers front to back, smallest first: each layer row is split by
+// the layer's geometry into the columns it fully covers and the edge pixels
+// it only partly covers, minus the columns nearer layers already cover fully.
+// The layers are then drawn back to front over what is left. That gives the
+// same frame as painting every layer whole, but hidden pixels are never
+// warped or blended, and a layer hidden entirely is not warped at all. A
+// fully covered span is copied; an edge pixel is blended by how much of its
+// sample fell inside the layer.
+//
+// Layers are not resized copies of the source here. Each box is sampled
+// straight from the two mip levels either side of the layer's scale, with
+// the scale folded into the rotation, and the two blended by the layer's
+// fractional level: trilinear filtering, at a cost that follows the layer's
+// size on screen rather than the source's.
+void FrameRenderer::compositeOpaqueLayers(cv::Mat& frame, int frame_index, double) const {
+    GIF_STAGE_TIMER("layers");
+    std::shared_ptr<const std::vector<cv::Mat>> pyramid = m_stages->mipPyramid(m_settings.image_path, m_source);
+    std::vector<cv::Size> sizes = layerSizes(m_source.size(), m_settings.scale_decay, maxLayers(), m_options.min_layer_size);
+
+    // Source coordinates a sample may span and still be fully inside the
+    // layer, and still touch it. A nearest-neighbour sample is all or nothing.
+    bool bilinear = m_options.warp_interpolation == cv::INTER_LINEAR;
+    double full_margin = bilinear ? 0.0 : 0.5;
+    double edge_margin = bilinear ? 1.0 : 0.5;
+    double angle_degrees = layerAngle(frame_index);
+    size_t coarsest_level = pyramid->size() - 1;
+
+    std::vector<LayerPlan> plans(sizes.size());
+    std::vector<ColumnSpan> covered(frame.rows); // Frame columns fully covered by the layers planned so far
+    for (size_t i = sizes.size(); i-- > 0;) {
+        const cv::Size& size = sizes[i];
+        LayerPlan& plan = plans[i];
+        plan.roi = cv::Rect((frame.cols / 2) - (size.width / 2), (frame.rows / 2) - (size.height / 2), size.width, size.height);
+        cv::Rect intersection = plan.roi & cv::Rect(0, 0, frame.cols, frame.rows);
+        if (intersection.empty()) continue;
+
+        layerMipLevel(m_source.size(), size, coarsest_level, bilinear, plan.level, plan.level_blend);
+
+        // warpAffine samples the layer at inverse * (x, y), which is linear
+        // in x along a row.
+        cv::Point2f center(size.width / 2.0F, size.height / 2.0F);
+        cv::invertAffineTransform(cv::getRotationMatrix2D(center, angle_degrees, 1.0), plan.inverse);
+        const double* m = plan.inverse.ptr<double>();
+        int x_begin = intersection.x - plan.roi.x;
+        int x_end = x_begin + intersection.width;
+        plan.first_row = intersection.y - plan.roi.y;
+        plan.rows.resize(intersection.height);
+
+        for (int r = 0; r < intersection.height; ++r) {
+            int y = plan.first_row + r;
+            double x_offset = m[1] * y + m[2];
+            double y_offset = m[4] * y + m[5];
+            double edge_first = x_begin, edge_last = x_end - 1;
+            clipToRange(m[0], x_offset, -edge_margin, size.width - 1 + edge_margin, edge_first, edge_last);
+            clipToRange(m[3], y_offset, -edge_margin, size.height - 1 + edge_margin, edge_first, edge_last);
+            double full_first = edge_first, full_last = edge_last;
+            clipToRange(m[0], x_offset, -full_margin, size.width - 1 + full_margin, full_first, full_last);
+            clipToRange(m[3], y_offset, -full_margin, size.height - 1 + full_margin, full_first, full_last);
+
+            LayerRowSpans& spans = plan.rows[r];
+            spans.edge = ColumnSpan{static_cast<int>(std::ceil(edge_first)), static_cast<int>(std::floor(edge_last)) + 1};
+            spans.full = ColumnSpan{static_cast<int>(std::ceil(full_first)), static_cast<int>(std::floor(full_last)) + 1};
+            if (spans.full.empty()) spans.full = ColumnSpan{spans.edge.end, spans.edge.end};
+
+            ColumnSpan& row_covered = covered[y + plan.roi.y];
+            spans.hidden = ColumnSpan{row_covered.begin - plan.roi.x, row_covered.end - plan.roi.x};
+            row_covered = coveredUnion(row_covered, ColumnSpan{spans.full.begin + plan.roi.x, spans.full.end + plan.roi.x});
+
+            ColumnSpan segments[2];
+            visibleSegments(spans, segments);
+            plan.visible = plan.visible || !segments[0].empty() || !segments[1].empty();
+        }
+    }
+
+    cv::Mat rotated_box, coarser_box;
+    for (size_t i = 0; i < sizes.size(); ++i) {
+        const LayerPlan& plan = plans[i];
+        if (!plan.visible) continue;
+        const cv::Size& size = sizes[i];
+        const double* m = plan.inverse.ptr<double>();
+        int num_rows = static_cast<int>(plan.rows.size());
+
+        for (int band = 0; band < num_rows; band += LAYER_BAND_ROWS) {
+            int band_end = std::min(num_rows, band + LAYER_BAND_ROWS);
+            // Box the band's visible pixels left and right of the hidden
+            // span separately, so the middle of a ring is not warped.
+            ColumnSpan boxes[2];
+            for (int r = band; r < band_end; ++r) {
+                ColumnSpan segments[2];
+                visibleSegments(plan.rows[r], segments);
+                for (int s = 0; s < 2; ++s) boxes[s].extend(segments[s]);
+            }
+            if (!boxes[0].empty() && !boxes[1].empty() && boxes[1].begin - boxes[0].end < LAYER_BOX_MIN_GAP) {
+                boxes[0].extend(boxes[1]);
+                boxes[1] = ColumnSpan();
+            }
+
+            for (const ColumnSpan& box : boxes) {
+                if (box.empty()) continue;
+                int box_top = plan.first_row + band;
+                cv::Size box_size(box.end - box.begin, band_end - band);
+                sampleLayerBox(*pyramid, plan.level, plan.level_blend, m, size, box.begin, box_top, box_size,
+                               m_options.warp_interpolation, cv::BORDER_REPLICATE, rotated_box, coarser_box);
+
+                for (int r = band; r < band_end; ++r) {
+                    int y = plan.first_row + r;
+                    const LayerRowSpans& spans = plan.rows[r];
+                    const uchar* src_row = rotated_box.ptr<uchar>(r - band);
+                    uchar* dst_row = frame.ptr<uchar>(y + plan.roi.y);
+                    auto blend = [&](int x) {
+                        double coverage = axisCoverage(m[0] * x + m[1] * y + m[2], size.width) *
+                                          axisCoverage(m[3] * x + m[4] * y + m[5], size.height);
+                        const uchar* src = src_row + (x - box.begin) * 3;
+                        uchar* dst = dst_row + (x + plan.roi.x) * 3;
+                        for (int k = 0; k < 3; ++k) {
+                            dst[k] = cv::saturate_cast<uchar>(src[k] * coverage + dst[k] * (1.0 - coverage));
+                        }
+                    };
+
+                    ColumnSpan segments[2];
+                    visibleSegments(spans, segments);
+                    for (const ColumnSpan& segment : segments) {
+                        int begin = std::max(segment.begin, box.begin);
+                        int end = std::min(segment.end, box.end);
+                        int copy_begin = std::max(begin, spans.full.begin);
+                        int copy_end = std::min(end, spans.full.end);
+                        if (copy_end <= copy_begin) copy_begin = copy_end = end;
+                        for (int x = begin; x < copy_begin; ++x) blend(x);
+                        if (copy_end > copy_begin) {
+                            std::memcpy(dst_row + (copy_begin + plan.roi.x) * 3, src_row + (copy_begin - box.begin) * 3,
+                                        (copy_end - copy_begin) * 3);
+                        }
+                        for (int x = copy_end; x < end; ++x) blend(x);
+                    }
+                }
+            }
+        }
+    }
+}
+
+// Feedback nests layer k + 1 inside layer k, scaled by scale_decay and
+// turned a further frame angle, so layer k is layer 0 under M^k for one
+// scale-and-turn step M. The n-layer stack C(n) is built by repeated
+// squaring, C(a + b) = M^a(C(b)) over C(a), from about 2 log2(n) warps of
+// premultiplied stacks instead of n layer warps. Each warp covers only the
+// box its stack shrinks into, so a tunnel hundreds of layers deep costs a
+// few full-frame passes, and every frame is still built from its index
+// alone.
+cv::Mat FrameRenderer::feedbackStack(int frame_index) const {
+    int depth = static_cast<int>(
+        layerSizes(m_source.size(), m_settings.scale_decay, maxLayers(), m_options.min_layer_size).size());
+    if (depth == 0) return cv::Mat::zeros(m_source.size(), CV_8UC4);
+    double angle_degrees = layerAngle(frame_index);
+    int interpolation = m_options.warp_interpolation;
+
+    cv::Mat power; // C(power_depth)
+    cv::warpAffine(m_feedback_source, power, cv::getRotationMatrix2D(cv::Point2f(width() / 2.0F, height() / 2.0F), angle_degrees, 1.0),
+                   m_source.size(), interpolation, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    int power_depth = 1;
+    cv::Mat stack; // C(stack_depth)
+    int stack_depth = 0;
+    for (int remaining = depth; remaining > 0; remaining >>= 1) {
+        if (remaining & 1) {
+            if (stack_depth == 0) {
+                stack = (remaining == 1) ? power : power.clone();
+            } else {
+                nestStack(power, angle_degrees * stack_depth, std::pow(m_settings.scale_decay, stack_depth), interpolation, stack);
+            }
+            stack_depth += power_depth;
+        }
+        if (remaining > 1) {
+            nestStack(power, angle_degrees * power_depth, std::pow(m_settings.scale_decay, power_depth), interpolation, power);
+            power_depth *= 2;
+        }
+    }
+    return stack;
+}
+
+void FrameRenderer::compositeFeedbackTunnel(cv::Mat& frame, int frame_index, double) const {
+    GIF_STAGE_TIMER("layers");
+    drawPremultiplied(feedbackStack(frame_index), frame);
+}
+
+// The Layers stage on its own, as premultiplied BGRA that drawCachedTunnel
+// can draw over any frame's starfield.
+cv::Mat FrameRenderer::renderTunnelComposite(int frame_index) const {
+    if (m_settings.tunnel_mode == TunnelMode::Feedback) return feedbackStack(frame_index);
+
+    cv::Mat layers = blankFrame();
+    (this->*m_layer_kernel)(layers, frame_index, 0.0);
+    cv::Mat composite;
+    if (!m_opaque) {
+        cv::cvtColor(layers, composite, cv::COLOR_RGBA2mRGBA);
+        return composite;
+    }
+    // Opaque layers drawn over black are already weighted by their coverage.
+    // Each layer lies inside the one before it, so the coverage of the whole
+    // tunnel is that of the first layer.
+    cv::Mat coverage = cv::Mat::zeros(layers.size(), CV_8UC1);
+    std::vector<cv::Size> sizes = layerSizes(m_source.size(), m_settings.scale_decay, maxLayers(), m_options.min_layer_size);
+    if (!sizes.empty()) {
+        const cv::Size& size = sizes.front();
+        cv::Mat placement = cv::getRotationMatrix2D(cv::Point2f(size.width / 2.0F, size.height / 2.0F), layerAngle(frame_index), 1.0);
+        placement.at<double>(0, 2) += (layers.cols / 2) - (size.width / 2);
+        placement.at<double>(1, 2) += (layers.rows / 2) - (size.height / 2);
+        cv::warpAffine(cv::Mat(size, CV_8UC1, cv::Scalar(255)), coverage, placement, layers.size(),
+                       m_options.warp_interpolation, cv::BORDER_CONSTANT, cv::Scalar::all(0));
+    }
+    cv::merge(std::vector<cv::Mat>{layers, coverage}, composite);
+    return composite;
+}
+
+// Draws the tunnel from the stage cache, compositing it first if no frame
+// at this angle has yet. The colour stages still run on every frame.
+void FrameRenderer::drawCachedTunnel(cv::Mat& frame, int frame_index, double) const {
+    RenderStageCache::TunnelKey key(m_settings.image_path, m_source.cols, m_source.rows, m_source.type(),
+                                    m_settings.scale_decay, maxLayers(), m_options.min_layer_size, m_options.warp_interpolation,
+                                    static_cast<int>(m_settings.tunnel_mode),
+                                    std::llround(layerAngle(frame_index) * ANGLE_STEPS_PER_DEGREE));
+    std::shared_ptr<const cv::Mat> composite = m_stages->tunnelComposite(key, [&](cv::Mat& layers) {
+        layers = renderTunnelComposite(frame_index);
+    });
+    GIF_STAGE_TIMER("layers");
+    drawPremultiplied(*composite, frame);
+}
+
+void FrameRenderer::applyVignette(cv::Mat& frame, int, double) const {
+    GIF_STAGE_TIMER("vignette");
+
+    std::shared_ptr<const cv::Mat> vignette_mask = m_stages->vignetteMask(frame.size(), m_settings.vignette_strength);
+    int channels = frame.channels();
+    for (int r = 0; r < frame.rows; ++r) {
+        uchar* row = frame.ptr<uchar>(r);
+        const float* mask_row = vignette_mask->ptr<float>(r);
+        for (int c = 0; c < frame.cols; ++c) {
+            uchar* pixel = row + c * channels;
+            float mask_val = mask_row[c];
+            for (int k = 0; k < 3; ++k) { // Apply to B, G, R channels
+                pixel[k] = static_cast<uchar>(pixel[k] * mask_val);
+            }
+        }
+    }
+}
+
+template <GlobalZoomMode Mode>
+double FrameRenderer::globalZoomScale(double frame_progress) const {
+    if constexpr (Mode == GlobalZoomMode::Linear) {
+        return 1.0 + (m_settings.linear_zoom_speed * frame_progress);
+    } else if constexpr (Mode == GlobalZoomMode::Oscillating) {
+        double sine_wave = sin(frame_progress * 2.0 * M_PI * m_settings.oscillating_zoom_frequency);
+        double zoom_center = m_settings.oscillating_zoom_midpoint;
+        return zoom_center + (m_settings.oscillating_zoom_amplitude * sine_wave);
+    } else {
+        return 1.0;
+    }
+}
+
+template <GlobalZoomMode Mode>
+void FrameRenderer::applyGlobalZoom(cv::Mat& frame, int, double frame_progress) const {
+    double global_scale = globalZoomScale<Mode>(frame_progress);
+    if (global_scale != 1.0) {
+        GIF_STAGE_TIMER("global_zoom");
+        cv::Mat zoom_matrix = cv::getRotationMatrix2D(cv::Point2f(frame.cols / 2.0f, frame.rows / 2.0f), 0.0, global_scale);
+        cv::warpAffine(frame, frame, zoom_matrix, frame.size(), m_options.warp_interpolation, cv::BORDER_REFLECT_101);
+    }
+}
+
+int FrameRenderer::pixelationLevel() const {
+    return static_cast<int>(std::lround(m_settings.pixelation_level * m_options.pixel_scale));
+}
+
+// Each block takes the mean of its pixels rather than one sample of them,
+// so pixelation neither aliases nor shimmers as the image moves under it.
+template <PixelationShape Shape>
+void FrameRenderer::applyPixelation(cv::Mat& frame, int, double) const {
+    int pixelation_level = pixelationLevel();
+    GIF_STAGE_TIMER("pixelation");
+
+    bool opaque = frame.channels() == 3;
+    if constexpr (Shape == PixelationShape::Hexagon) {
+        std::shared_ptr<const HexCellMap> cells = m_stages->hexCells(frame.size(), pixelation_level);
+        opaque ? averageCells<3>(frame, *cells) : averageCells<4>(frame, *cells);
+    } else {
+        int block_width = (Shape == PixelationShape::Wide) ? 2 * pixelation_level : pixelation_level;
+        int block_height = (Shape == PixelationShape::Tall) ? 2 * pixelation_level : pixelation_level;
+        opaque ? averageBlocks<3>(frame, block_width, block_height) : averageBlocks<4>(frame, block_width, block_height);
+    }
+}
+
+// The wave, and the global zoom before it unless Mode is None, as a single
+// remap. Output pixel (c, r) takes the wave's sample point, clamped into the
+// frame as the wave's replicated border would, and maps it back through
+// the zoom; only that last point is sampled, with the zoom's reflected
+// border. The maps are written directly in remap's fixed-point form.
+template <GlobalZoomMode Mode, WaveDirection Direction>
+void FrameRenderer::applyGeometry(cv::Mat& frame, int frame_index, double frame_progress) const {
+    GIF_STAGE_TIMER(Mode == GlobalZoomMode::None ? "wave" : "geometry");
+
+    int width = frame.cols;
+    int height = frame.rows;
+    double amplitude = m_settings.wave_amplitude * m_options.pixel_scale;
+    double frequency = m_settings.wave_frequency / m_options.pixel_scale;
+    double phase = frame_index * 0.1;
+    double inverse_scale = 1.0 / globalZoomScale<Mode>(frame_progress);
+    double center_x = width / 2.0;
+    double center_y = height / 2.0;
+
+    // The offset depends only on the row (horizontal) or the column
+    // (vertical), so each sine is taken once rather than per pixel.
+    std::vector<double> offsets(Direction == WaveDirection::Horizontal ? height : width);
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        offsets[i] = amplitude * std::sin(i * frequency + phase);
+    }
+
+    bool nearest = m_options.warp_interpolation == cv::INTER_NEAREST;
+    double subpixels = nearest ? 1.0 : static_cast<double>(cv::INTER_TAB_SIZE);
+    auto unzoom = [&](double position, double center, int size) {
+        position = std::min(std::max(position, 0.0), size - 1.0);
+        return cvRound(((position - center) * inverse_scale + center) * subpixels);
+    };
+
+    cv::Mat map_xy(height, width, CV_16SC2), map_fraction, distorted_frame;
+    if (!nearest) map_fraction.create(height, width, CV_16UC1);
+    for (int r = 0; r < height; ++r) {
+        short* xy_row = map_xy.ptr<short>(r);
+        ushort* fraction_row = nearest ? nullptr : map_fraction.ptr<ushort>(r);
+        int fixed_row_y = unzoom(r, center_y, height);
+        for (int c = 0; c < width; ++c) {
+            int fixed_x, fixed_y;
+            if constexpr (Direction == WaveDirection::Horizontal) {
+                fixed_x = unzoom(c + offsets[r], center_x, width);
+                fixed_y = fixed_row_y;
+            } else {
+                fixed_x = unzoom(c, center_x, width);
+                fixed_y = unzoom(r + offsets[c], center_y, height);
+            }
+            if (nearest) {
+                xy_row[2 * c] = cv::saturate_cast<short>(fixed_x);
+                xy_row[2 * c + 1] = cv::saturate_cast<short>(fixed_y);
+            } else {
+                xy_row[2 * c] = cv::saturate_cast<short>(fixed_x >> cv::INTER_BITS);
+                xy_row[2 * c + 1] = cv::saturate_cast<short>(fixed_y >> cv::INTER_BITS);
+                fraction_row[c] = static_cast<ushort>((fixed_y & (cv::INTER_TAB_SIZE - 1)) * cv::INTER_TAB_SIZE +
+                                                      (fixed_x & (cv::INTER_TAB_SIZE - 1)));
+            }
+        }
+    }
+    cv::remap(frame, distorted_frame, map_xy, map_fraction, m_options.warp_interpolation, cv::BORDER_REFLECT_101);
+    frame = distorted_frame;
+}
+
+void FrameRenderer::applyHuePulse(cv::Mat& frame, int frame_index, double frame_progress) const {
+    GIF_STAGE_TIMER("hue_pulse");
+
+    bool has_alpha = frame.channels() == 4;
+    cv::Mat hsv_frame, temp_bgr;
+    if (has_alpha) {
+        cv::cvtColor(frame, temp_bgr, cv::COLOR_BGRA2BGR);
+        cv::cvtColor(temp_bgr, hsv_frame, cv::COLOR_BGR2HSV);
+    } else {
+        cv::cvtColor(frame, hsv_frame, cv::COLOR_BGR2HSV);
+    }
+
+    double saturation_pulse = sin(frame_progress * 2.0 * M_PI * (m_settings.hue_speed / 4.0));
+    double saturation_multiplier = 1.0 + (saturation_pulse * (m_settings.hue_intensity - 1.0));
+
+    for (int r = 0; r < hsv_frame.rows; ++r) {
+        for (int c = 0; c < hsv_frame.cols; ++c) {
+            auto& pixel = hsv_frame.at<cv::Vec3b>(r, c);
+            pixel[0] = static_cast<uchar>(std::fmod((pixel[0] + (frame_index * m_settings.hue_speed)), 180.0));
+            pixel[1] = cv::saturate_cast<uchar>(pixel[1] * saturation_multiplier);
+        }
+    }
+    if (has_alpha) {
+        cv::cvtColor(hsv_frame, temp_bgr, cv::COLOR_HSV2BGR);
+        cv::cvtColor(temp_bgr, frame, cv::COLOR_BGR2BGRA);
+    } else {
+        cv::cvtColor(hsv_frame, frame, cv::COLOR_HSV2BGR);
+    }
+}
+
+void FrameRenderer::applyColorInvert(cv::Mat& frame, int frame_index, double) const {
+    if (frame_index % m_settings.color_invert_frequency != 0) return;
+    GIF_STAGE_TIMER("color_invert");
+
+    if (frame.channels() == 3) {
+        cv::bitwise_not(frame, frame);
+        return;
+    }
+    cv::Mat bgr_frame;
+    cv::cvtColor(frame, bgr_frame, cv::COLOR_BGRA2BGR);
+    cv::bitwise_not(bgr_frame, bgr_frame);
+    cv::cvtColor(bgr_frame, frame, cv::COLOR_BGR2BGRA);
+}
+
+void FrameRenderer::applyBlur(cv::Mat& frame, int, double) const {
+    double blur_radius = m_settings.blur_radius * m_options.pixel_scale;
+    GIF_STAGE_TIMER("blur");
+
+    stackedBoxBlur(frame, blur_radius);
+}
+
+void FrameRenderer::writeOutput(const cv::Mat& frame, cv::Mat& output, FrameOutputFormat format) const {
+    GIF_STAGE_TIMER("output");
+    // Each case is a single pass that writes straight into `output`, which
+    // keeps its buffer when it already has the right size and type.
+    if (frame.channels() == 3) {
+        bool rgb = format == FrameOutputFormat::RGBA || format == FrameOutputFormat::OpaqueRGBA;
+        cv::cvtColor(frame, output, rgb ? cv::COLOR_BGR2RGBA : cv::COLOR_BGR2BGRA);
+        return;
+    }
+    switch (format) {
+    case FrameOutputFormat::BGRA:
+        frame.copyTo(output);
+        break;
+    case FrameOutputFormat::RGBA:
+        cv::cvtColor(frame, output, cv::COLOR_BGRA2RGBA);
+        break;
+    case FrameOutputFormat::OpaqueBGRA:
+        cv::bitwise_or(frame, cv::Scalar(0, 0, 0, 255), output);
+        break;
+    case FrameOutputFormat::OpaqueRGBA:
+        cv::cvtColor(frame, output, cv::COLOR_BGRA2RGBA);
+        cv::bitwise_or(output, cv::Scalar(0, 0, 0, 255), output);
+        break;
+    }
+}
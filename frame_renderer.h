@@ -0,0 +1,237 @@
+// frame_renderer.h
+#ifndef FRAME_RENDERER_H
+#define FRAME_RENDERER_H
+
+#include <opencv2/opencv.hpp>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+#include "gif_settings.h"
+
+// Resolution (square) that GIFs are rendered at.
+const int GIF_WORKING_SIZE = 600;
+
+// Part of the RenderCache key. Bump it whenever a change alters the
+// rendered pixels, so GIFs cached by older builds are not served.
+const int RENDERER_VERSION = 9;
+
+// Decodes an image from disk into the BGRA layout the renderer works in,
+// at its original resolution. Returns an empty Mat on failure.
+cv::Mat decodeSourceImage(const std::string& path);
+
+// Decodes an image and resizes it to size x size.
+cv::Mat loadSourceImage(const std::string& path, int size, int interpolation);
+
+class RenderStageCache;
+
+// Everything derived from an input image before any frame is rendered.
+struct PreparedSource {
+    std::string path;
+    cv::Mat working; // GIF_WORKING_SIZE square, as GifWorker renders from
+    cv::Mat preview; // Downscaled from `working`; empty if no preview size was given
+    std::shared_ptr<RenderStageCache> stages; // Holds the mip pyramid of `working`, for GifWorker
+};
+
+// Decodes `path` and builds the working and preview sources and the working
+// source's mip pyramid, so the whole preparation can run off the GUI thread
+// as soon as an image is picked.
+// `working` is empty if the image could not be loaded.
+PreparedSource prepareSource(const std::string& path, int preview_size);
+
+// 64-bit FNV-1a checksum of a frame's size, type and pixels. Identical
+// frames give identical checksums on every platform, so renders can be
+// compared against a reference without keeping the reference images.
+std::uint64_t frameChecksum(const cv::Mat& frame);
+
+// Checksum of a whole animation from the checksums of its frames.
+std::uint64_t combineChecksums(const std::vector<std::uint64_t>& checksums);
+
+// Pixel layout renderFrame writes its result in.
+enum class FrameOutputFormat {
+    BGRA,       // The renderer's working layout
+    RGBA,       // What gif-h expects
+    OpaqueBGRA, // Alpha forced to 255; the memory layout of QImage::Format_RGB32 on little-endian hosts
+    OpaqueRGBA  // Alpha forced to 255; the memory layout of QImage::Format_RGBX8888
+};
+
+// The steps of the frame pipeline, in the order renderFrame runs them.
+enum class FrameStage {
+    Starfield,
+    Layers,
+    Vignette,
+    GlobalZoom,
+    Pixelation,
+    Wave,
+    Geometry, // GlobalZoom and Wave in one resample, when no pixelation runs between them
+    HuePulse,
+    ColorInvert,
+    Blur
+};
+
+const char* frameStageName(FrameStage stage);
+
+// Knobs that let callers trade quality for speed, e.g. the live preview
+// renders at a reduced size with cheaper interpolation.
+struct FrameRenderOptions {
+    int warp_interpolation = cv::INTER_LINEAR; // Layer, rotation, zoom and wave resampling
+    int min_layer_size = 2; // Layers smaller than this end the tunnel
+    int layer_limit = 0; // Caps settings.max_layers when > 0
+    // Multiplier for settings measured in pixels (wave, blur, pixelation,
+    // spiral radius) so a smaller render looks like a scaled-down GIF.
+    double pixel_scale = 1.0;
+};
+
+// The hexagon each pixel of a frame falls in, for hexagonal pixelation.
+struct HexCellMap {
+    cv::Mat cell_ids; // CV_32SC1, frame-sized
+    std::vector<int> cell_sizes; // Pixels in each cell
+};
+
+// Intermediates that do not change from frame to frame: the source's mip
+// pyramid, the tunnel as composited at each angle, the vignette mask and
+// the hexagon map. Each is keyed by the inputs it depends on, so renderers
+// for different settings of the same source (a sweep, the preview while a
+// slider moves) compute each one only once. Stages built from the source
+// are also keyed by a source id, settings.image_path, so a cache shared by
+// mistake between sources misses instead of serving the wrong image; still,
+// use one cache per source. Thread-safe.
+class RenderStageCache {
+public:
+    // The source followed by successive cv::pyrDown halvings, down to a
+    // single row or column. Layers are resampled from the nearest level, not
+    // the full source, so each costs in proportion to its own size.
+    std::shared_ptr<const std::vector<cv::Mat>> mipPyramid(const std::string& source_id, const cv::Mat& source);
+    std::shared_ptr<const cv::Mat> vignetteMask(cv::Size size, double strength);
+    // Pointy-topped hexagons `cell_width` pixels across, in offset rows.
+    std::shared_ptr<const HexCellMap> hexCells(cv::Size size, int cell_width);
+
+    // A frame's tunnel layers alone, as premultiplied BGRA. They depend only
+    // on the source, the layer settings and the frame's angle, which the key
+    // holds; `render` draws them when they are not cached yet.
+    using TunnelKey = std::tuple<std::string, int, int, int, double, int, int, int, int, long long>;
+    std::shared_ptr<const cv::Mat> tunnelComposite(const TunnelKey& key, const std::function<void(cv::Mat&)>& render);
+    // Drops the oldest composites until at most `max_bytes` of them are
+    // kept, e.g. once a render is done with them.
+    void trimTunnels(size_t max_bytes);
+
+    static const size_t MAX_TUNNEL_BYTES = size_t(256) << 20; // Composites kept, across all angles
+
+    template <typename Value> struct Entry;
+
+private:
+    static const size_t MAX_ENTRIES = 16; // Per stage; the oldest entry is dropped first
+
+    using PyramidKey = std::tuple<std::string, int, int, int>;
+    using VignetteKey = std::tuple<int, int, double>;
+    using HexKey = std::tuple<int, int, int>;
+
+    std::mutex m_mutex;
+    std::map<PyramidKey, std::shared_ptr<Entry<std::vector<cv::Mat>>>> m_pyramids;
+    std::deque<PyramidKey> m_pyramid_order;
+    std::map<TunnelKey, std::shared_ptr<Entry<cv::Mat>>> m_tunnels;
+    std::deque<TunnelKey> m_tunnel_order;
+    std::map<VignetteKey, std::shared_ptr<Entry<cv::Mat>>> m_vignettes;
+    std::deque<VignetteKey> m_vignette_order;
+    std::map<HexKey, std::shared_ptr<Entry<HexCellMap>>> m_hex_cells;
+    std::deque<HexKey> m_hex_order;
+};
+
+// The tunnel at a given angle is the same in every frame, so when the
+// rotation brings angles round again within an animation, the renderer
+// composites each angle once and keeps it. Returns the memory that takes
+// for these settings at this frame size, or 0 if no angle repeats or they
+// would not fit in RenderStageCache::MAX_TUNNEL_BYTES.
+size_t tunnelCompositeBytes(const GifSettings& settings, cv::Size size);
+
+// Renders single frames of the animation from a prepared BGRA source.
+// Shared by GifWorker and the live preview so both use the same pipeline.
+class FrameRenderer {
+public:
+    // Renderers of the same source may pass one shared `stage_cache`;
+    // otherwise the renderer keeps its own.
+    FrameRenderer(const cv::Mat& source_bgra, const GifSettings& settings,
+                  const FrameRenderOptions& options = FrameRenderOptions(),
+                  std::shared_ptr<RenderStageCache> stage_cache = nullptr);
+
+    // Fully opaque sources are rendered in 3-channel BGR, which carries a
+    // quarter less data through every stage; layer edges are then blended
+    // from their geometry instead of an alpha channel.
+    bool isOpaque() const { return m_opaque; }
+
+    // A cleared working frame in the layout the stages expect: BGR for
+    // opaque sources, BGRA otherwise.
+    cv::Mat blankFrame() const;
+
+    // Renders frame `frame_index` (0-based) into `output`. If `output`
+    // already has the frame size and CV_8UC4 type, it is written in place, so
+    // it may alias a caller-owned buffer such as a QImage. The colour
+    // conversion to `format` is the last stage of the pipeline. A frame
+    // depends only on its index and the settings (random stars included, via
+    // settings.seed), so one instance can render any frames, in any order,
+    // on several threads at once.
+    void renderFrame(int frame_index, cv::Mat& output, FrameOutputFormat format = FrameOutputFormat::BGRA) const;
+
+    // Runs one pipeline stage on a working frame from blankFrame(), exactly as
+    // renderFrame would for `frame_index`; a stage the settings disable does
+    // nothing. Lets gif_bench time stages alone.
+    void applyStage(FrameStage stage, cv::Mat& frame, int frame_index) const;
+
+    int width() const { return m_source.cols; }
+    int height() const { return m_source.rows; }
+
+private:
+    // A stage kernel, specialized at compile time on the stage's mode.
+    using StageKernel = void (FrameRenderer::*)(cv::Mat& frame, int frame_index, double frame_progress) const;
+    struct PipelineStage {
+        FrameStage stage;
+        StageKernel kernel;
+    };
+
+    cv::Mat m_source;
+    GifSettings m_settings;
+    FrameRenderOptions m_options;
+    std::shared_ptr<RenderStageCache> m_stages;
+    double m_angle_per_frame = 0.0;
+    std::uint64_t m_star_key = 0; // Squares key derived from settings.seed
+    bool m_opaque = false;
+    cv::Mat m_feedback_source; // Premultiplied BGRA, for TunnelMode::Feedback only
+    // The enabled stages in pipeline order, picked once from the settings so
+    // frames neither test disabled stages nor compare modes per pixel.
+    std::vector<PipelineStage> m_pipeline;
+    StageKernel m_layer_kernel = nullptr; // Draws the tunnel itself, cached or not
+
+    void buildPipeline();
+
+    template <StarfieldPattern Pattern>
+    void drawStarfield(cv::Mat& frame, int frame_index, double frame_progress) const;
+    int maxLayers() const;
+    double layerAngle(int frame_index) const;
+    void compositeLayers(cv::Mat& frame, int frame_index, double frame_progress) const;
+    void compositeOpaqueLayers(cv::Mat& frame, int frame_index, double frame_progress) const;
+    cv::Mat feedbackStack(int frame_index) const;
+    void compositeFeedbackTunnel(cv::Mat& frame, int frame_index, double frame_progress) const;
+    cv::Mat renderTunnelComposite(int frame_index) const;
+    void drawCachedTunnel(cv::Mat& frame, int frame_index, double frame_progress) const;
+    void applyVignette(cv::Mat& frame, int frame_index, double frame_progress) const;
+    template <GlobalZoomMode Mode>
+    double globalZoomScale(double frame_progress) const;
+    template <GlobalZoomMode Mode>
+    void applyGlobalZoom(cv::Mat& frame, int frame_index, double frame_progress) const;
+    int pixelationLevel() const;
+    template <PixelationShape Shape>
+    void applyPixelation(cv::Mat& frame, int frame_index, double frame_progress) const;
+    template <GlobalZoomMode Mode, WaveDirection Direction>
+    void applyGeometry(cv::Mat& frame, int frame_index, double frame_progress) const;
+    void applyHuePulse(cv::Mat& frame, int frame_index, double frame_progress) const;
+    void applyColorInvert(cv::Mat& frame, int frame_index, double frame_progress) const;
+    void applyBlur(cv::Mat& frame, int frame_index, double frame_progress) const;
+    void writeOutput(const cv::Mat& frame, cv::Mat& output, FrameOutputFormat format) const;
+};
+
+#endif // FRAME_RENDERER_H
@@ -0,0 +1,512 @@
+// gif_bench.cpp (Benchmark Entry Point)
+//
+// Times every stage of the frame pipeline in isolation, plus GIF encoding
+// and whole frames, over synthetic and bundled images at several sizes with
+// and without alpha. With --macro it instead renders complete GIFs for the
+// default preset and a seeded corpus of random configurations. Prints a
+// table to stderr and, with --json, writes the results as JSON so runs of
+// different builds can be compared.
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <random>
+#include <string>
+#include <vector>
+#include <opencv2/opencv.hpp>
+#include "frame_renderer.h"
+#include "gif_encoder.h"
+#include "gif_settings.h"
+#include "gif_settings_json.h"
+#include "gif_worker.h"
+#include "mat_pool.h"
+#include "stage_timer.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#ifndef GIF_BENCH_DATA_DIR
+#define GIF_BENCH_DATA_DIR "."
+#endif
+
+namespace {
+
+const int DEFAULT_SIZES[] = {250, 600, 1080};
+const double DEFAULT_MIN_SECONDS = 0.25;
+const int MIN_ITERATIONS = 3;
+const int MAX_ITERATIONS = 2000;
+const int BENCH_FRAME_INDEX = 20; // Mid-animation, so rotation and zoom are non-trivial
+const int DEFAULT_CORPUS_SIZE = 24;
+
+// Counts the bytes of every cv::Mat buffer allocated while it is the
+// default allocator. Buffers are still owned and freed by the inner allocator.
+class CountingAllocator : public cv::MatAllocator {
+public:
+    explicit CountingAllocator(cv::MatAllocator* inner) : m_inner(inner) {}
+
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override {
+        cv::UMatData* u = m_inner->allocate(dims, sizes, type, data, step, flags, usage_flags);
+        if (u && !data) m_allocated_bytes += u->size;
+        return u;
+    }
+    bool allocate(cv::UMatData* data, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override {
+        return m_inner->allocate(data, access_flags, usage_flags);
+    }
+    void deallocate(cv::UMatData* data) const override {
+        m_inner->deallocate(data);
+    }
+
+    size_t allocatedBytes() const { return m_allocated_bytes; }
+
+private:
+    cv::MatAllocator* m_inner;
+    mutable std::atomic<size_t> m_allocated_bytes{0};
+};
+
+CountingAllocator* g_allocator = nullptr;
+
+struct BenchSource {
+    std::string name;
+    bool alpha;
+    cv::Mat bgra;
+};
+
+struct BenchResult {
+    std::string source;
+    bool alpha;
+    int size;
+    std::string stage;
+    int iterations;
+    double ns_per_frame;
+    double bytes_per_frame;
+
+    double nsPerPixel() const { return ns_per_frame / (static_cast<double>(size) * size); }
+    double framesPerSecond() const { return ns_per_frame > 0 ? 1e9 / ns_per_frame : 0.0; }
+
+    QJsonObject toJson() const {
+        return QJsonObject{
+            {"source", QString::fromStdString(source)},
+            {"alpha", alpha},
+            {"size", size},
+            {"stage", QString::fromStdString(stage)},
+            {"iterations", iterations},
+            {"ns_per_frame", ns_per_frame},
+            {"ns_per_pixel", nsPerPixel()},
+            {"frames_per_second", framesPerSecond()},
+            {"bytes_allocated_per_frame", bytes_per_frame}};
+    }
+};
+
+// Settings with every stage switched on, so each one has work to do.
+GifSettings benchSettings() {
+    GifSettings settings = GifSettings::getDefaultSettings();
+    settings.pixelation_level = 4;
+    settings.color_invert_frequency = 1;
+    settings.blur_radius = 1.5;
+    return settings;
+}
+
+// Fades the alpha channel out towards the corners, like a cut-out logo.
+void applyRadialAlpha(cv::Mat& bgra) {
+    cv::Point2f center(bgra.cols / 2.0F, bgra.rows / 2.0F);
+    double radius = std::min(center.x, center.y);
+    for (int r = 0; r < bgra.rows; ++r) {
+        for (int c = 0; c < bgra.cols; ++c) {
+            double dist = cv::norm(cv::Point2f(c, r) - center) / radius;
+            bgra.at<cv::Vec4b>(r, c)[3] = cv::saturate_cast<uchar>(255.0 * (1.0 - dist) * 2.0);
+        }
+    }
+}
+
+cv::Mat makeSyntheticSource(int size) {
+    cv::Mat bgra(size, size, CV_8UC4);
+    for (int r = 0; r < size; ++r) {
+        for (int c = 0; c < size; ++c) {
+            bgra.at<cv::Vec4b>(r, c) = cv::Vec4b(static_cast<uchar>(c * 255 / size), static_cast<uchar>(r * 255 / size),
+                                                 static_cast<uchar>((c ^ r) & 0xFF), 255);
+        }
+    }
+    return bgra;
+}
+
+std::vector<BenchSource> makeSources(int size, const QStringList& image_paths) {
+    std::vector<std::pair<std::string, cv::Mat>> opaque_sources;
+    opaque_sources.emplace_back("synthetic", makeSyntheticSource(size));
+    for (const QString& path : image_paths) {
+        cv::Mat image = loadSourceImage(path.toStdString(), size, cv::INTER_LANCZOS4);
+        if (image.empty()) {
+            std::fprintf(stderr, "Skipping unreadable image %s\n", qPrintable(path));
+            continue;
+        }
+        cv::bitwise_or(image, cv::Scalar(0, 0, 0, 255), image);
+        opaque_sources.emplace_back(QFileInfo(path).fileName().toStdString(), image);
+    }
+
+    std::vector<BenchSource> sources;
+    for (const auto& source : opaque_sources) {
+        sources.push_back(BenchSource{source.first, false, source.second});
+        cv::Mat with_alpha = source.second.clone();
+        applyRadialAlpha(with_alpha);
+        sources.push_back(BenchSource{source.first, true, with_alpha});
+    }
+    return sources;
+}
+
+// Runs `prepare` then `body` repeatedly until `min_seconds` of `body` time
+// has been measured. Only `body` is timed and counted for allocations.
+BenchResult measure(const std::function<void()>& prepare, const std::function<void()>& body, double min_seconds) {
+    using clock = std::chrono::steady_clock;
+    prepare();
+    body(); // Warm-up: fills stage caches and faults in buffers
+
+    BenchResult result{};
+    std::chrono::nanoseconds total(0);
+    size_t allocated = 0;
+    int iterations = 0;
+    while ((iterations < MIN_ITERATIONS || total.count() < min_seconds * 1e9) && iterations < MAX_ITERATIONS) {
+        prepare();
+        size_t allocated_before = g_allocator->allocatedBytes();
+        clock::time_point start = clock::now();
+        body();
+        total += std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start);
+        allocated += g_allocator->allocatedBytes() - allocated_before;
+        ++iterations;
+    }
+    result.iterations = iterations;
+    result.ns_per_frame = static_cast<double>(total.count()) / iterations;
+    result.bytes_per_frame = static_cast<double>(allocated) / iterations;
+    return result;
+}
+
+void benchSource(const BenchSource& source, const GifSettings& settings, const QStringList& stage_filter,
+                 double min_seconds, const QString& scratch_gif, std::vector<BenchResult>& results) {
+    int size = source.bgra.cols;
+    FrameRenderOptions options;
+    options.pixel_scale = static_cast<double>(size) / GIF_WORKING_SIZE;
+    FrameRenderer renderer(source.bgra, settings, options);
+    auto wanted = [&stage_filter](const char* stage) { return stage_filter.isEmpty() || stage_filter.contains(stage); };
+    auto record = [&](const char* stage, BenchResult result) {
+        result.source = source.name;
+        result.alpha = source.alpha;
+        result.size = size;
+        result.stage = stage;
+        results.push_back(result);
+        std::fprintf(stderr, "%-16s %-6s %5d  %-13s %12.0f ns/frame %8.2f ns/px %9.1f fps %12.0f B/frame\n",
+                     source.name.c_str(), source.alpha ? "alpha" : "opaque", size, stage, result.ns_per_frame,
+                     result.nsPerPixel(), result.framesPerSecond(), result.bytes_per_frame);
+    };
+
+    // Capture what each stage receives in a real frame, then replay it.
+    const FrameStage stages[] = {FrameStage::Starfield, FrameStage::Layers, FrameStage::Vignette,
+                                 FrameStage::GlobalZoom, FrameStage::Pixelation, FrameStage::Wave,
+                                 FrameStage::Geometry, FrameStage::HuePulse, FrameStage::ColorInvert, FrameStage::Blur};
+    cv::Mat frame = renderer.blankFrame();
+    std::vector<cv::Mat> stage_inputs;
+    for (FrameStage stage : stages) {
+        stage_inputs.push_back(frame.clone());
+        renderer.applyStage(stage, frame, BENCH_FRAME_INDEX);
+    }
+
+    cv::Mat work;
+    for (size_t i = 0; i < stage_inputs.size(); ++i) {
+        FrameStage stage = stages[i];
+        if (!wanted(frameStageName(stage))) continue;
+        const cv::Mat& input = stage_inputs[i];
+        record(frameStageName(stage), measure([&]() { input.copyTo(work); },
+                                              [&]() { renderer.applyStage(stage, work, BENCH_FRAME_INDEX); },
+                                              min_seconds));
+    }
+
+    // Alternate two consecutive frames, since gif-h encodes each frame
+    // against the previous one.
+    cv::Mat rgba_frames[2];
+    renderer.renderFrame(BENCH_FRAME_INDEX, rgba_frames[0], FrameOutputFormat::RGBA);
+    renderer.renderFrame(BENCH_FRAME_INDEX + 1, rgba_frames[1], FrameOutputFormat::RGBA);
+    if (wanted("encode")) {
+        GifEncoder encoder;
+        if (encoder.begin(scratch_gif.toStdString(), size, size, 8)) {
+            int next = 0;
+            record("encode", measure([]() {}, [&]() { encoder.writeFrame(rgba_frames[next]); next ^= 1; }, min_seconds));
+            encoder.end();
+        }
+    }
+
+    if (wanted("full_frame")) {
+        int frame_index = 0;
+        cv::Mat output(size, size, CV_8UC4);
+        record("full_frame", measure([]() {}, [&]() {
+            renderer.renderFrame(frame_index, output, FrameOutputFormat::RGBA);
+            frame_index = (frame_index + 1) % settings.num_frames;
+        }, min_seconds));
+    }
+}
+
+// Peak resident set size of the process so far, in bytes.
+qint64 peakRssBytes() {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) return 0;
+    return static_cast<qint64>(counters.PeakWorkingSetSize);
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#if defined(__APPLE__)
+    return static_cast<qint64>(usage.ru_maxrss); // Bytes on macOS
+#else
+    return static_cast<qint64>(usage.ru_maxrss) * 1024; // Kilobytes on Linux
+#endif
+#endif
+}
+
+// Lets the next peakRssBytes() report the peak of one configuration rather
+// than of the whole run. Only Linux can reset the high-water mark; elsewhere
+// the peak stays cumulative.
+void resetPeakRss() {
+#if defined(__linux__)
+    QFile clear_refs("/proc/self/clear_refs");
+    if (clear_refs.open(QIODevice::WriteOnly)) clear_refs.write("5");
+#endif
+}
+
+struct MacroResult {
+    int index;
+    std::string label;
+    GifSettings settings;
+    bool ok;
+    double wall_msecs;
+    qint64 output_bytes;
+    qint64 peak_rss_bytes;
+    qint64 mat_allocations;
+    qint64 heap_allocations; // Mat buffers the pool could not supply
+
+    double framesPerSecond() const { return wall_msecs > 0 ? settings.num_frames * 1000.0 / wall_msecs : 0.0; }
+
+    QJsonObject toJson() const {
+        return QJsonObject{
+            {"index", index},
+            {"label", QString::fromStdString(label)},
+            {"ok", ok},
+            {"frames", settings.num_frames},
+            {"wall_ms", wall_msecs},
+            {"frames_per_second", framesPerSecond()},
+            {"output_bytes", output_bytes},
+            {"peak_rss_bytes", peak_rss_bytes},
+            {"mat_allocations", mat_allocations},
+            {"heap_allocations", heap_allocations},
+            {"settings", settingsToJson(settings)}};
+    }
+};
+
+// Renders complete GIFs, exactly as the GUI and CLI do, for the default
+// preset and `corpus_size` "Cosmic Chaos" configurations drawn from `seed`.
+// The same seed always yields the same corpus.
+std::vector<MacroResult> runMacro(const cv::Mat& working_source, int corpus_size, unsigned int seed,
+                                  const QString& scratch_gif) {
+    std::vector<std::pair<std::string, GifSettings>> configs;
+    GifSettings defaults = GifSettings::getDefaultSettings();
+    defaults.seed = 1; // Same starfield in every run
+    configs.emplace_back("default", defaults);
+    std::mt19937 gen(seed);
+    for (int i = 0; i < corpus_size; ++i) {
+        configs.emplace_back("chaos_" + std::to_string(i), GifSettings::randomized(defaults, gen));
+    }
+
+    std::vector<MacroResult> results;
+    for (size_t i = 0; i < configs.size(); ++i) {
+        MacroResult result{static_cast<int>(i), configs[i].first, configs[i].second, false, 0.0, 0, 0, 0, 0};
+        QFile::remove(scratch_gif);
+        resetPeakRss();
+
+        // Each worker builds its own stage cache, so no configuration
+        // benefits from work done for the previous one.
+        std::shared_ptr<StageProfile> profile = std::make_shared<StageProfile>();
+        GifWorker worker(result.settings, scratch_gif.toStdString(), working_source);
+        worker.setStageProfile(profile);
+        QObject::connect(&worker, &GifWorker::finished, [&result](bool ok, const QString&) { result.ok = ok; });
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        worker.process();
+        result.wall_msecs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        result.output_bytes = QFileInfo(scratch_gif).size();
+        result.peak_rss_bytes = peakRssBytes();
+        result.mat_allocations = profile->allocations().allocations();
+        result.heap_allocations = profile->allocations().heapAllocations();
+        results.push_back(result);
+
+        std::fprintf(stderr, "%-10s %-4s %9.1f ms %7.1f fps %10lld B %8.1f MB peak %6lld heap allocs\n",
+                     result.label.c_str(), result.ok ? "ok" : "FAIL", result.wall_msecs, result.framesPerSecond(),
+                     static_cast<long long>(result.output_bytes), result.peak_rss_bytes / (1024.0 * 1024.0),
+                     static_cast<long long>(result.heap_allocations));
+    }
+    QFile::remove(scratch_gif);
+    return results;
+}
+
+// Prints the slowest configurations with their settings so a cliff can be
+// reproduced with `gif_creator_cli --settings`.
+QJsonArray reportSlowest(const std::vector<MacroResult>& results, int count) {
+    std::vector<const MacroResult*> ranked;
+    for (const MacroResult& result : results) {
+        ranked.push_back(&result);
+    }
+    std::sort(ranked.begin(), ranked.end(),
+              [](const MacroResult* a, const MacroResult* b) { return a->wall_msecs > b->wall_msecs; });
+    ranked.resize(std::min<size_t>(ranked.size(), static_cast<size_t>(std::max(0, count))));
+
+    QJsonArray slowest;
+    std::fprintf(stderr, "\nSlowest configurations:\n");
+    for (const MacroResult* result : ranked) {
+        QByteArray settings_json = QJsonDocument(settingsToJson(result->settings)).toJson(QJsonDocument::Compact);
+        std::fprintf(stderr, "%-10s %9.1f ms  %s\n", result->label.c_str(), result->wall_msecs, settings_json.constData());
+        slowest.append(result->index);
+    }
+    return slowest;
+}
+
+bool writeJson(const QJsonObject& report, const QString& json_path) {
+    QByteArray json = QJsonDocument(report).toJson(QJsonDocument::Indented);
+    if (json_path == "-") {
+        std::fwrite(json.constData(), 1, static_cast<size_t>(json.size()), stdout);
+        return true;
+    }
+    QFile file(json_path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        std::fprintf(stderr, "Cannot write %s\n", qPrintable(json_path));
+        return false;
+    }
+    file.write(json);
+    return true;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("gif_bench");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Per-stage and end-to-end benchmarks of the GIF rendering pipeline.");
+    parser.addHelpOption();
+    QCommandLineOption jsonOption("json", "Write results as JSON to a file, or '-' for stdout.", "file");
+    QCommandLineOption sizesOption("sizes", "Comma-separated frame sizes in pixels.", "list", "250,600,1080");
+    QCommandLineOption minTimeOption("min-time", "Seconds to measure each stage for.", "seconds",
+                                     QString::number(DEFAULT_MIN_SECONDS));
+    QCommandLineOption imageOption("image", "Extra image to benchmark. May be repeated.", "path");
+    QCommandLineOption stageOption("stage", "Only run this stage (e.g. blur, encode, full_frame). May be repeated.", "name");
+    QCommandLineOption threadsOption("threads", "OpenCV worker threads. Defaults to OpenCV's choice.", "count");
+    QCommandLineOption macroOption("macro", "Render complete GIFs for the default preset and a random corpus instead.");
+    QCommandLineOption corpusOption("corpus", "Number of random configurations in --macro mode.", "count",
+                                    QString::number(DEFAULT_CORPUS_SIZE));
+    QCommandLineOption seedOption("seed", "Seed of the random corpus in --macro mode.", "seed", "1");
+    QCommandLineOption slowestOption("slowest", "Number of slowest configurations to list in --macro mode.", "count", "5");
+    parser.addOption(jsonOption);
+    parser.addOption(sizesOption);
+    parser.addOption(minTimeOption);
+    parser.addOption(imageOption);
+    parser.addOption(stageOption);
+    parser.addOption(threadsOption);
+    parser.addOption(macroOption);
+    parser.addOption(corpusOption);
+    parser.addOption(seedOption);
+    parser.addOption(slowestOption);
+    parser.process(app);
+
+    // Preview frames are cached by this hash, so a setting missing from it
+    // would serve stale frames.
+    GifSettings reseeded;
+    reseeded.seed = reseeded.seed + 1;
+    if (reseeded.hash() == GifSettings().hash()) {
+        std::fprintf(stderr, "GifSettings::hash() ignores the starfield seed.\n");
+        return 1;
+    }
+
+    std::vector<int> sizes;
+    for (const QString& size_text : parser.value(sizesOption).split(',')) {
+        bool ok = false;
+        int size = size_text.trimmed().toInt(&ok);
+        if (!ok || size < 16) {
+            std::fprintf(stderr, "Invalid size '%s'.\n", qPrintable(size_text));
+            return 1;
+        }
+        sizes.push_back(size);
+    }
+    if (sizes.empty()) sizes.assign(std::begin(DEFAULT_SIZES), std::end(DEFAULT_SIZES));
+    double min_seconds = parser.value(minTimeOption).toDouble();
+    if (parser.isSet(threadsOption)) cv::setNumThreads(parser.value(threadsOption).toInt());
+
+    QStringList image_paths = parser.values(imageOption);
+    QString bundled_image = QDir(GIF_BENCH_DATA_DIR).filePath("gif_create.png");
+    if (image_paths.isEmpty() && QFileInfo::exists(bundled_image)) {
+        image_paths.append(bundled_image);
+    }
+
+    QJsonObject report{
+        {"benchmark", "gif_bench"},
+        {"opencv_version", CV_VERSION},
+        {"opencv_threads", cv::getNumThreads()}};
+
+    if (parser.isSet(macroOption)) {
+        // Macro runs render with the same allocator as gif_creator_cli, and
+        // use the first image at GIF resolution, as a real render would.
+        installPooledMatAllocator();
+        cv::Mat working_source;
+        if (!image_paths.isEmpty()) {
+            working_source = loadSourceImage(image_paths.first().toStdString(), GIF_WORKING_SIZE, cv::INTER_LANCZOS4);
+        }
+        if (working_source.empty()) working_source = makeSyntheticSource(GIF_WORKING_SIZE);
+
+        unsigned int seed = parser.value(seedOption).toUInt();
+        std::vector<MacroResult> results = runMacro(working_source, parser.value(corpusOption).toInt(), seed,
+                                                    QDir::temp().filePath("gif_bench_macro.gif"));
+        QJsonArray result_array;
+        for (const MacroResult& result : results) {
+            result_array.append(result.toJson());
+        }
+        report.insert("mode", "macro");
+        report.insert("seed", static_cast<qint64>(seed));
+        report.insert("results", result_array);
+        report.insert("slowest", reportSlowest(results, parser.value(slowestOption).toInt()));
+        report.insert("process_peak_rss_bytes", peakRssBytes());
+    } else {
+        CountingAllocator allocator(cv::Mat::getDefaultAllocator());
+        g_allocator = &allocator;
+        cv::Mat::setDefaultAllocator(&allocator);
+
+        QString scratch_gif = QDir::temp().filePath("gif_bench_scratch.gif");
+        GifSettings settings = benchSettings();
+        std::vector<BenchResult> results;
+        for (int size : sizes) {
+            for (const BenchSource& source : makeSources(size, image_paths)) {
+                benchSource(source, settings, parser.values(stageOption), min_seconds, scratch_gif, results);
+            }
+        }
+        QFile::remove(scratch_gif);
+        cv::Mat::setDefaultAllocator(nullptr);
+
+        QJsonArray result_array;
+        for (const BenchResult& result : results) {
+            result_array.append(result.toJson());
+        }
+        report.insert("mode", "stages");
+        report.insert("min_time_s", min_seconds);
+        report.insert("results", result_array);
+    }
+
+    if (parser.isSet(jsonOption) && !writeJson(report, parser.value(jsonOption))) {
+        return 1;
+    }
+    return 0;
+}
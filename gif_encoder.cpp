@@ -0,0 +1,51 @@
+// gif_encoder.cpp
+#include "gif_encoder.h"
+#include "stage_timer.h"
+#include "gif.h"
+
+GifEncoder::GifEncoder() : m_writer(new GifWriter()) {}
+
+GifEncoder::~GifEncoder() {
+    end();
+}
+
+bool GifEncoder::begin(const std::string& path, int width, int height, int frame_delay_cs) {
+    end();
+    m_width = width;
+    m_height = height;
+    m_frame_delay_cs = frame_delay_cs;
+    m_open = GifBegin(m_writer.get(), path.c_str(), width, height, frame_delay_cs, 8, false);
+    return m_open;
+}
+
+bool GifEncoder::writeFrame(const cv::Mat& rgba) {
+    if (!m_open || rgba.type() != CV_8UC4 || rgba.cols != m_width || rgba.rows != m_height || !rgba.isContinuous()) {
+        return false;
+    }
+    if (!m_writer->f) return false;
+
+    // The steps of GifWriteFrame without dithering, run one by one so that
+    // palette building and LZW coding are timed separately.
+    const uint8_t* previous = m_writer->firstFrame ? nullptr : m_writer->oldImage;
+    m_writer->firstFrame = false;
+    GifPalette palette;
+    {
+        GIF_STAGE_TIMER("palette");
+        GifMakePalette(previous, rgba.data, m_width, m_height, 8, false, &palette);
+        GifThresholdImage(previous, rgba.data, m_writer->oldImage, m_width, m_height, &palette);
+    }
+    GIF_STAGE_TIMER("lzw");
+    GifWriteLzwImage(m_writer->f, m_writer->oldImage, 0, 0, m_width, m_height, m_frame_delay_cs, &palette);
+    return true;
+}
+
+bool GifEncoder::end() {
+    if (!m_open) return false;
+    m_open = false;
+    GIF_STAGE_TIMER("write");
+    return GifEnd(m_writer.get());
+}
+
+long GifEncoder::bytesWritten() const {
+    return (m_open && m_writer->f) ? std::ftell(m_writer->f) : 0;
+}
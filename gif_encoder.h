@@ -0,0 +1,33 @@
+// gif_encoder.h
+#ifndef GIF_ENCODER_H
+#define GIF_ENCODER_H
+
+#include <memory>
+#include <string>
+#include <opencv2/opencv.hpp>
+
+struct GifWriter;
+
+// Writes an animated GIF one frame at a time. Wraps gif-h, which defines
+// its functions in the header, so only gif_encoder.cpp includes it.
+class GifEncoder {
+public:
+    GifEncoder();
+    ~GifEncoder(); // Finishes the file if end() was not called
+
+    bool begin(const std::string& path, int width, int height, int frame_delay_cs);
+    // `rgba` must be a continuous CV_8UC4 RGBA frame of the size given to begin().
+    bool writeFrame(const cv::Mat& rgba);
+    bool end();
+    // Size of the file written so far.
+    long bytesWritten() const;
+
+private:
+    std::unique_ptr<GifWriter> m_writer;
+    int m_width = 0;
+    int m_height = 0;
+    int m_frame_delay_cs = 0;
+    bool m_open = false;
+};
+
+#endif // GIF_ENCODER_H
@@ -4,34 +4,97 @@
 
 #include <string>
 #include <vector>
+#include <functional>
+#include <random>
+
+// The settings that pick between modes. Settings files and the GUI's combo
+// boxes use the names from enumNames(), in the same order as the values.
+enum class RotationDirection { Clockwise, CounterClockwise, None };
+enum class StarfieldPattern { None, Random, Spiral };
+enum class WaveDirection { None, Horizontal, Vertical };
+enum class GlobalZoomMode { None, Linear, Oscillating };
+enum class TunnelMode { Layered, Feedback };
+enum class PixelationShape { Square, Wide, Tall, Hexagon };
+
+inline const std::vector<std::string>& enumNames(RotationDirection) {
+    static const std::vector<std::string> names{"Clockwise", "Counter-Clockwise", "None"};
+    return names;
+}
+inline const std::vector<std::string>& enumNames(StarfieldPattern) {
+    static const std::vector<std::string> names{"None", "Random", "Spiral"};
+    return names;
+}
+inline const std::vector<std::string>& enumNames(WaveDirection) {
+    static const std::vector<std::string> names{"None", "Horizontal", "Vertical"};
+    return names;
+}
+inline const std::vector<std::string>& enumNames(GlobalZoomMode) {
+    static const std::vector<std::string> names{"None", "Linear", "Oscillating"};
+    return names;
+}
+inline const std::vector<std::string>& enumNames(TunnelMode) {
+    static const std::vector<std::string> names{"Layered", "Feedback"};
+    return names;
+}
+inline const std::vector<std::string>& enumNames(PixelationShape) {
+    static const std::vector<std::string> names{"Square", "Wide", "Tall", "Hexagon"};
+    return names;
+}
+
+template <typename Enum>
+const std::string& enumName(Enum value) {
+    return enumNames(value)[static_cast<size_t>(value)];
+}
+
+// Sets `value` from its name; returns false, leaving it unchanged, for a
+// name that is not one of enumNames().
+template <typename Enum>
+bool parseEnum(const std::string& name, Enum& value) {
+    const std::vector<std::string>& names = enumNames(value);
+    for (size_t i = 0; i < names.size(); ++i) {
+        if (names[i] == name) {
+            value = static_cast<Enum>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Deepest tunnel the settings allow.
+const int MAX_TUNNEL_LAYERS = 200;
 
 // This struct holds all the configurable settings for GIF generation.
 struct GifSettings {
     // Core Settings
     std::string image_path = "";
     int num_frames = 60;
-    std::string rotation_direction = "Clockwise";
+    RotationDirection rotation_direction = RotationDirection::Clockwise;
     double rotation_speed = 3.6; 
     
     // Layering / Tunnel Effect Settings
     int max_layers = 10;
     double scale_decay = 0.85;
+    // Feedback nests each layer inside the one before it, turned a further
+    // step, and costs the same however deep the tunnel goes.
+    TunnelMode tunnel_mode = TunnelMode::Layered;
 
     // Post-Processing Effects
     int num_stars = 0;
-    std::string advanced_starfield_pattern = "None";
+    StarfieldPattern advanced_starfield_pattern = StarfieldPattern::None;
+    int seed = 0; // Seeds the random starfield; 0 draws a new seed for every render, never served from the render cache
     int pixelation_level = 0;
+    PixelationShape pixelation_shape = PixelationShape::Square; // Wide and Tall blocks are twice as long one way
     int color_invert_frequency = 0; 
     double wave_amplitude = 0.0;
     double wave_frequency = 0.0;
-    std::string wave_direction = "None";
+    WaveDirection wave_direction = WaveDirection::None;
     double blur_radius = 0.0;
     double vignette_strength = 0.0; // New setting for vignette
     double hue_speed = 3.6;
     double hue_intensity = 1.0;
     
     // Global Zoom Settings
-    std::string global_zoom_mode = "Oscillating";
+    GlobalZoomMode global_zoom_mode = GlobalZoomMode::Oscillating;
     double linear_zoom_speed = 0.5;
     double oscillating_zoom_amplitude = 0.1;
     double oscillating_zoom_frequency = 1.0;
@@ -43,28 +106,31 @@ struct GifSettings {
         // Core Settings
         defaults.image_path = "";
         defaults.num_frames = 60; // cycles: 60
-        defaults.rotation_direction = "Clockwise"; // spin dir: clockwise
+        defaults.rotation_direction = RotationDirection::Clockwise; // spin dir: clockwise
         defaults.rotation_speed = 3.6; // spin speed: 3.6
 
         // Layering / Tunnel Effect Settings
         defaults.max_layers = 12; // layers: 12
         defaults.scale_decay = 0.92; // warp: 0.92
+        defaults.tunnel_mode = TunnelMode::Layered; // tunnel: layered
 
         // Post-Processing Effects
         defaults.num_stars = 400; // stars: 400
-        defaults.advanced_starfield_pattern = "Random"; // star pattern: Random
+        defaults.advanced_starfield_pattern = StarfieldPattern::Random; // star pattern: Random
+        defaults.seed = 0; // star seed: random
         defaults.pixelation_level = 0; // pixelation: 0
+        defaults.pixelation_shape = PixelationShape::Square; // pixel shape: square
         defaults.color_invert_frequency = 0; // invert freq: 0
         defaults.wave_amplitude = 3.6; // wave amp: 3.6
         defaults.wave_frequency = 0.10; // wave freq: 0.10
-        defaults.wave_direction = "Horizontal"; // wave dir: horizontal
+        defaults.wave_direction = WaveDirection::Horizontal; // wave dir: horizontal
         defaults.blur_radius = 0.0; // haze: 0.0
         defaults.vignette_strength = 1.0; // vignette: 1.0
         defaults.hue_speed = 11.7; // pulse speed: 11.7
         defaults.hue_intensity = 1.50; // pulse intensity: 1.50
         
         // Global Zoom Settings
-        defaults.global_zoom_mode = "Oscillating"; // zoom mode: oscillating
+        defaults.global_zoom_mode = GlobalZoomMode::Oscillating; // zoom mode: oscillating
         defaults.linear_zoom_speed = 0.5; // (no change to linear_zoom_speed as it's not in the new defaults)
         defaults.oscillating_zoom_amplitude = 0.40; // oscillating strength: 0.40
         defaults.oscillating_zoom_frequency = 2.15; // oscillating speed: 2.15
@@ -72,6 +138,67 @@ struct GifSettings {
 
         return defaults;
     }
+
+    // Returns `base` with its effect settings rolled at random, within the
+    // ranges the "Cosmic Chaos" button uses.
+    static GifSettings randomized(const GifSettings& base, std::mt19937& gen) {
+        GifSettings settings = base;
+        settings.rotation_speed = std::uniform_real_distribution<>(0.0, 10.0)(gen);
+        settings.hue_speed = std::uniform_real_distribution<>(0.0, 15.0)(gen);
+        settings.hue_intensity = std::uniform_real_distribution<>(0.0, 1.5)(gen);
+
+        settings.max_layers = std::uniform_int_distribution<>(5, 20)(gen);
+        settings.blur_radius = std::uniform_real_distribution<>(0.0, 3.0)(gen);
+        settings.vignette_strength = std::uniform_real_distribution<>(0.0, 0.75)(gen);
+        settings.num_stars = std::uniform_int_distribution<>(0, 500)(gen);
+        settings.advanced_starfield_pattern = static_cast<StarfieldPattern>(std::uniform_int_distribution<>(0, 2)(gen));
+        settings.pixelation_level = std::uniform_int_distribution<>(0, 10)(gen);
+        settings.color_invert_frequency = std::uniform_int_distribution<>(0, 40)(gen);
+        settings.wave_amplitude = std::uniform_real_distribution<>(0.0, 25.0)(gen);
+        settings.wave_frequency = std::uniform_real_distribution<>(0.0, 0.75)(gen);
+        settings.wave_direction = static_cast<WaveDirection>(std::uniform_int_distribution<>(0, 2)(gen));
+
+        settings.oscillating_zoom_midpoint = std::uniform_real_distribution<>(0.8, 1.2)(gen);
+        return settings;
+    }
+
+    // Combined hash of every setting, used to key caches of rendered frames.
+    std::size_t hash() const {
+        std::size_t combined = 0;
+        auto combine = [&combined](std::size_t value) {
+            combined ^= value + 0x9e3779b9 + (combined << 6) + (combined >> 2);
+        };
+        std::hash<std::string> hash_string;
+        std::hash<double> hash_double;
+        std::hash<int> hash_int;
+
+        combine(hash_string(image_path));
+        combine(hash_int(num_frames));
+        combine(hash_int(static_cast<int>(rotation_direction)));
+        combine(hash_double(rotation_speed));
+        combine(hash_int(max_layers));
+        combine(hash_double(scale_decay));
+        combine(hash_int(static_cast<int>(tunnel_mode)));
+        combine(hash_int(num_stars));
+        combine(hash_int(static_cast<int>(advanced_starfield_pattern)));
+        combine(hash_int(this->seed));
+        combine(hash_int(pixelation_level));
+        combine(hash_int(static_cast<int>(pixelation_shape)));
+        combine(hash_int(color_invert_frequency));
+        combine(hash_double(wave_amplitude));
+        combine(hash_double(wave_frequency));
+        combine(hash_int(static_cast<int>(wave_direction)));
+        combine(hash_double(blur_radius));
+        combine(hash_double(vignette_strength));
+        combine(hash_double(hue_speed));
+        combine(hash_double(hue_intensity));
+        combine(hash_int(static_cast<int>(global_zoom_mode)));
+        combine(hash_double(linear_zoom_speed));
+        combine(hash_double(oscillating_zoom_amplitude));
+        combine(hash_double(oscillating_zoom_frequency));
+        combine(hash_double(oscillating_zoom_midpoint));
+        return combined;
+    }
 };
 
 #endif // GIF_SETTINGS_H
\ No newline at end of file
@@ -0,0 +1,210 @@
+// gif_settings_json.cpp
+#include "gif_settings_json.h"
+#include <QJsonValue>
+#include <QStringList>
+#include <cmath>
+#include <type_traits>
+
+namespace {
+
+// Calls visit(name, field) for every GifSettings field, so reading and
+// writing JSON cannot drift apart when a setting is added.
+template <typename Settings, typename Visitor>
+void forEachField(Settings& s, Visitor&& visit) {
+    visit("image_path", s.image_path);
+    visit("num_frames", s.num_frames);
+    visit("rotation_direction", s.rotation_direction);
+    visit("rotation_speed", s.rotation_speed);
+    visit("max_layers", s.max_layers);
+    visit("scale_decay", s.scale_decay);
+    visit("tunnel_mode", s.tunnel_mode);
+    visit("num_stars", s.num_stars);
+    visit("advanced_starfield_pattern", s.advanced_starfield_pattern);
+    visit("seed", s.seed);
+    visit("pixelation_level", s.pixelation_level);
+    visit("pixelation_shape", s.pixelation_shape);
+    visit("color_invert_frequency", s.color_invert_frequency);
+    visit("wave_amplitude", s.wave_amplitude);
+    visit("wave_frequency", s.wave_frequency);
+    visit("wave_direction", s.wave_direction);
+    visit("blur_radius", s.blur_radius);
+    visit("vignette_strength", s.vignette_strength);
+    visit("hue_speed", s.hue_speed);
+    visit("hue_intensity", s.hue_intensity);
+    visit("global_zoom_mode", s.global_zoom_mode);
+    visit("linear_zoom_speed", s.linear_zoom_speed);
+    visit("oscillating_zoom_amplitude", s.oscillating_zoom_amplitude);
+    visit("oscillating_zoom_frequency", s.oscillating_zoom_frequency);
+    visit("oscillating_zoom_midpoint", s.oscillating_zoom_midpoint);
+}
+
+QJsonValue toJsonValue(int value) { return QJsonValue(value); }
+QJsonValue toJsonValue(double value) { return QJsonValue(value); }
+QJsonValue toJsonValue(const std::string& value) { return QJsonValue(QString::fromStdString(value)); }
+
+template <typename Enum, typename = std::enable_if_t<std::is_enum<Enum>::value>>
+QJsonValue toJsonValue(Enum value) { return QJsonValue(QString::fromStdString(enumName(value))); }
+
+bool fromJsonValue(const QJsonValue& json, int& value) {
+    if (!json.isDouble()) return false;
+    double number = json.toDouble();
+    if (number != std::floor(number)) return false;
+    value = static_cast<int>(number);
+    return true;
+}
+
+bool fromJsonValue(const QJsonValue& json, double& value) {
+    if (!json.isDouble()) return false;
+    value = json.toDouble();
+    return true;
+}
+
+bool fromJsonValue(const QJsonValue& json, std::string& value) {
+    if (!json.isString()) return false;
+    value = json.toString().toStdString();
+    return true;
+}
+
+// Mode settings are stored by name and only accept the names they know.
+template <typename Enum, typename = std::enable_if_t<std::is_enum<Enum>::value>>
+bool fromJsonValue(const QJsonValue& json, Enum& value) {
+    return json.isString() && parseEnum(json.toString().toStdString(), value);
+}
+
+bool fromText(const QString& text, int& value) {
+    bool ok = false;
+    int parsed = text.toInt(&ok);
+    if (ok) value = parsed;
+    return ok;
+}
+
+bool fromText(const QString& text, double& value) {
+    bool ok = false;
+    double parsed = text.toDouble(&ok);
+    if (ok) value = parsed;
+    return ok;
+}
+
+bool fromText(const QString& text, std::string& value) {
+    value = text.toStdString();
+    return true;
+}
+
+template <typename Enum, typename = std::enable_if_t<std::is_enum<Enum>::value>>
+bool fromText(const QString& text, Enum& value) {
+    return parseEnum(text.toStdString(), value);
+}
+
+void setError(QString* error, const QString& message) {
+    if (error) *error = message;
+}
+
+// Why `key` could not be read into `field`.
+QString wrongTypeMessage(const QString& key) {
+    return QString("Setting '%1' has a value of the wrong type.").arg(key);
+}
+
+QString invalidValueMessage(const QString& key, int) { return wrongTypeMessage(key); }
+QString invalidValueMessage(const QString& key, double) { return wrongTypeMessage(key); }
+QString invalidValueMessage(const QString& key, const std::string&) { return wrongTypeMessage(key); }
+
+template <typename Enum, typename = std::enable_if_t<std::is_enum<Enum>::value>>
+QString invalidValueMessage(const QString& key, const Enum& field) {
+    QStringList names;
+    for (const std::string& name : enumNames(field)) {
+        names.append(QString::fromStdString(name));
+    }
+    return QString("Setting '%1' must be one of: %2.").arg(key, names.join(", "));
+}
+
+} // namespace
+
+QJsonObject settingsToJson(const GifSettings& settings) {
+    QJsonObject json;
+    forEachField(settings, [&json](const char* name, const auto& field) {
+        json.insert(QString(name), toJsonValue(field));
+    });
+    return json;
+}
+
+bool settingsFromJson(const QJsonObject& json, GifSettings& settings, QString* error) {
+    GifSettings parsed = settings;
+    for (const QString& key : json.keys()) {
+        bool known = false;
+        QString invalid;
+        forEachField(parsed, [&](const char* name, auto& field) {
+            if (known || key != name) return;
+            known = true;
+            if (!fromJsonValue(json.value(key), field)) invalid = invalidValueMessage(key, field);
+        });
+        if (!known) {
+            setError(error, QString("Unknown setting '%1'.").arg(key));
+            return false;
+        }
+        if (!invalid.isEmpty()) {
+            setError(error, invalid);
+            return false;
+        }
+    }
+
+    settings = parsed;
+    return true;
+}
+
+bool applySettingOverride(const QString& assignment, GifSettings& settings, QString* error) {
+    int separator = assignment.indexOf('=');
+    if (separator <= 0) {
+        setError(error, QString("Expected key=value, got '%1'.").arg(assignment));
+        return false;
+    }
+    QString key = assignment.left(separator).trimmed();
+    QString value = assignment.mid(separator + 1).trimmed();
+
+    bool known = false;
+    QString invalid;
+    forEachField(settings, [&](const char* name, auto& field) {
+        if (known || key != name) return;
+        known = true;
+        if (!fromText(value, field)) invalid = invalidValueMessage(key, field);
+    });
+    if (!known) {
+        setError(error, QString("Unknown setting '%1'.").arg(key));
+        return false;
+    }
+    if (!invalid.isEmpty()) {
+        setError(error, invalid);
+        return false;
+    }
+    return true;
+}
+
+bool validateSettings(const GifSettings& settings, QString* error) {
+    QString invalid;
+    forEachField(settings, [&invalid](const char* name, const auto& field) {
+        if constexpr (std::is_same<std::decay_t<decltype(field)>, double>::value) {
+            if (invalid.isEmpty() && !std::isfinite(field)) {
+                invalid = QString("Setting '%1' must be a finite number.").arg(name);
+            }
+        }
+    });
+    auto require = [&invalid](bool valid, const QString& message) {
+        if (invalid.isEmpty() && !valid) invalid = message;
+    };
+    require(settings.num_frames >= 1, "Setting 'num_frames' must be at least 1.");
+    require(settings.max_layers >= 1 && settings.max_layers <= MAX_TUNNEL_LAYERS,
+            QString("Setting 'max_layers' must be between 1 and %1.").arg(MAX_TUNNEL_LAYERS));
+    require(settings.scale_decay > 0.0 && settings.scale_decay < 1.0,
+            "Setting 'scale_decay' must be greater than 0 and less than 1.");
+    // Turn counts are computed in int.
+    require(settings.rotation_speed >= 0.0 && settings.rotation_speed <= 1000.0,
+            "Setting 'rotation_speed' must be between 0 and 1000.");
+    require(settings.num_stars >= 0, "Setting 'num_stars' must not be negative.");
+    require(settings.pixelation_level >= 0, "Setting 'pixelation_level' must not be negative.");
+    require(settings.color_invert_frequency >= 0, "Setting 'color_invert_frequency' must not be negative.");
+    require(settings.blur_radius >= 0.0, "Setting 'blur_radius' must not be negative.");
+    if (!invalid.isEmpty()) {
+        setError(error, invalid);
+        return false;
+    }
+    return true;
+}
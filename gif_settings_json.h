@@ -0,0 +1,25 @@
+// gif_settings_json.h
+#ifndef GIF_SETTINGS_JSON_H
+#define GIF_SETTINGS_JSON_H
+
+#include <QJsonObject>
+#include <QString>
+#include "gif_settings.h"
+
+// JSON form of GifSettings, keyed by the struct's field names.
+QJsonObject settingsToJson(const GifSettings& settings);
+
+// Copies the fields present in `json` into `settings`; fields it leaves out
+// keep their current value. Returns false and describes the problem in
+// `error` on an unknown key or a value of the wrong type.
+bool settingsFromJson(const QJsonObject& json, GifSettings& settings, QString* error = nullptr);
+
+// Applies a single "key=value" assignment, as given on the command line.
+bool applySettingOverride(const QString& assignment, GifSettings& settings, QString* error = nullptr);
+
+// Checks that `settings` can be rendered: every number finite, and counts,
+// sizes and the layer decay within the ranges the GUI offers. Returns false
+// and names the first bad setting in `error` otherwise.
+bool validateSettings(const GifSettings& settings, QString* error = nullptr);
+
+#endif // GIF_SETTINGS_JSON_H
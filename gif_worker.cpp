@@ -1,258 +1,137 @@
 // gif_worker.cpp
 #include "gif_worker.h"
-#include "gif.h"
+#include "frame_renderer.h"
+#include "gif_encoder.h"
+#include "render_cache.h"
+#include "render_progress.h"
+#include "stage_timer.h"
 #include <QDebug>
+#include <QFileInfo>
 #include <opencv2/opencv.hpp>
-#include <cmath>
 #include <algorithm>
+#include <chrono>
 #include <random>
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+GifWorker::GifWorker(const GifSettings& settings, const std::string& output_path, const cv::Mat& working_source,
+                     std::shared_ptr<RenderStageCache> stage_cache)
+    : m_settings(settings), m_output_path(output_path), m_working_source(working_source),
+      m_stage_cache(std::move(stage_cache)), m_profile(std::make_shared<StageProfile>()),
+      m_progress(std::make_shared<RenderProgress>()), m_isCancelled(false) {}
 
-GifWorker::GifWorker(const GifSettings& settings, const std::string& output_path)
-    : m_settings(settings), m_output_path(output_path), m_isCancelled(false) {}
-
-void GifWorker::emitProgress(int percentage, const std::string& message) {
-    emit progressUpdated(percentage, QString::fromStdString(message));
+void GifWorker::setStageProfile(std::shared_ptr<StageProfile> profile) {
+    m_profile = profile ? std::move(profile) : std::make_shared<StageProfile>();
 }
 
 void GifWorker::cancel() {
     m_isCancelled = true;
 }
 
+bool GifWorker::fetchFromCache(const QString& cache_key) {
+    CachedRender cached;
+    QString output_path = QString::fromStdString(m_output_path);
+    {
+        GIF_STAGE_TIMER("cache_fetch");
+        if (!m_cache->fetch(cache_key, output_path, &cached)) return false;
+    }
+    // Frame checksums can only be served if they were recorded with the entry.
+    if (m_record_checksums && static_cast<int>(cached.frame_checksums.size()) != m_settings.num_frames) return false;
+
+    m_seed = cached.seed;
+    m_frame_checksums = m_record_checksums ? cached.frame_checksums : std::vector<std::uint64_t>();
+    m_progress->complete(QFileInfo(output_path).size());
+    m_cache_hit = true;
+    return true;
+}
+
 void GifWorker::process() {
     qDebug() << "Worker: Implementing 'Layered Collage' with new effects.";
+    StageProfileScope profile_scope(m_profile.get());
+    m_progress->start(m_settings.num_frames);
+    m_cache_hit = false;
+
+    // Seed 0 has no key, so it always renders; it is stored below under the
+    // seed it draws.
+    QString cache_key;
+    if (m_cache) {
+        GIF_STAGE_TIMER("cache_lookup");
+        if (m_source_digest.isEmpty()) m_source_digest = RenderCache::sourceDigest(m_settings.image_path);
+        cache_key = RenderCache::key(m_source_digest, m_settings);
+    }
+    if (!cache_key.isEmpty() && fetchFromCache(cache_key)) {
+        emit finished(true, QString::fromStdString(m_output_path));
+        return;
+    }
 
-    cv::Mat original_image_bgr = cv::imread(m_settings.image_path, cv::IMREAD_UNCHANGED);
-    if (original_image_bgr.empty()) {
+    cv::Mat original_image_rgba = m_working_source;
+    if (original_image_rgba.empty()) {
+        original_image_rgba = loadSourceImage(m_settings.image_path, GIF_WORKING_SIZE, cv::INTER_LANCZOS4);
+    }
+    if (original_image_rgba.empty()) {
         emit finished(false, "Error: Could not load input image.");
         return;
     }
 
-    cv::Mat original_image_rgba;
-    if (original_image_bgr.channels() < 4) {
-         cv::cvtColor(original_image_bgr, original_image_rgba, cv::COLOR_BGR2BGRA);
-    } else {
-        original_image_rgba = original_image_bgr.clone();
+    m_seed = m_settings.seed;
+    while (m_seed == 0) {
+        m_seed = static_cast<int>(std::random_device()() & 0x7FFFFFFF);
     }
-    
-    cv::resize(original_image_rgba, original_image_rgba, cv::Size(600, 600), 0, 0, cv::INTER_LANCZOS4);
-
-    int width = original_image_rgba.cols;
-    int height = original_image_rgba.rows;
+    GifSettings render_settings = m_settings;
+    render_settings.seed = m_seed;
+    FrameRenderer renderer(original_image_rgba, render_settings, FrameRenderOptions(), m_stage_cache);
+    int width = renderer.width();
+    int height = renderer.height();
     int frame_delay_cs = 8;
 
-    GifWriter writer;
-    if (!GifBegin(&writer, m_output_path.c_str(), width, height, frame_delay_cs, 8, false)) {
+    GifEncoder encoder;
+    if (!encoder.begin(m_output_path, width, height, frame_delay_cs)) {
         emit finished(false, "Error: Failed to open GIF for writing.");
         return;
     }
-    
-    std::random_device rd;
-    std::mt19937 gen(rd());
-    std::uniform_int_distribution<> dist_x(0, width - 1);
-    std::uniform_int_distribution<> dist_y(0, height - 1);
-    
-    double num_rotations = std::round(m_settings.rotation_speed / 2.0);
-    double total_rotation_degrees = num_rotations * 360.0;
-    
-    if (m_settings.rotation_direction == "Counter-Clockwise") {
-        total_rotation_degrees *= -1.0;
-    } else if (m_settings.rotation_direction == "None") {
-        total_rotation_degrees = 0.0;
-    }
-    
-    double angle_per_frame = (m_settings.num_frames > 0) ? (total_rotation_degrees / m_settings.num_frames) : 0.0;
-
-    for (int i = 0; i < m_settings.num_frames; ++i) {
-        if (m_isCancelled) { qDebug() << "Worker: Cancellation requested."; break; }
-        emitProgress((i + 1) * 100 / m_settings.num_frames, "Frame " + std::to_string(i + 1));
-        
-        cv::Mat frame = cv::Mat::zeros(height, width, CV_8UC4);
-        double frame_progress = static_cast<double>(i) / m_settings.num_frames;
-
-        if (m_settings.num_stars > 0 && m_settings.advanced_starfield_pattern != "None") {
-            if (m_settings.advanced_starfield_pattern == "Random") {
-                for (int s = 0; s < m_settings.num_stars; ++s) {
-                    cv::circle(frame, cv::Point(dist_x(gen), dist_y(gen)), 1, cv::Scalar(255, 255, 255, 255), cv::FILLED);
-                }
-            } else if (m_settings.advanced_starfield_pattern == "Spiral") {
-                for (int j = 0; j < m_settings.num_stars; ++j) {
-                    double angle = (0.1 * j) + (i * 0.05);
-                    int x = static_cast<int>(width / 2.0 + (2 * j) * std::cos(angle));
-                    int y = static_cast<int>(height / 2.0 + (2 * j) * std::sin(angle));
-                    if (x >= 0 && x < width && y >= 0 && y < height) {
-                        cv::circle(frame, cv::Point(x, y), 1, cv::Scalar(255, 255, 255, 255), cv::FILLED);
-                    }
-                }
-            }
-        }
-        
-        double effective_max_scale = 1.0;
-        double current_layer_scale = effective_max_scale;
-        
-        for (int layer = 0; layer < m_settings.max_layers; ++layer) {
-            int scaled_width = static_cast<int>(width * current_layer_scale);
-            int scaled_height = static_cast<int>(height * current_layer_scale);
-
-            if (scaled_width < 2 || scaled_height < 2) break;
-
-            cv::Mat resized_image;
-            cv::resize(original_image_rgba, resized_image, cv::Size(scaled_width, scaled_height), 0, 0, cv::INTER_LANCZOS4);
-
-            double angle_degrees = angle_per_frame * i;
-
-            cv::Point2f center(scaled_width / 2.0F, scaled_height / 2.0F);
-            cv::Mat rot_mat = cv::getRotationMatrix2D(center, angle_degrees, 1.0);
-            cv::Mat rotated_image;
-            cv::warpAffine(resized_image, rotated_image, rot_mat, resized_image.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0, 0, 0, 0));
-
-            int paste_x = (width / 2) - (scaled_width / 2);
-            int paste_y = (height / 2) - (scaled_height / 2);
-
-            cv::Rect roi(paste_x, paste_y, rotated_image.cols, rotated_image.rows);
-            cv::Rect frame_roi(0, 0, frame.cols, frame.rows);
-            cv::Rect intersection = roi & frame_roi;
-
-            if (intersection.empty()) continue;
-
-            cv::Mat frame_sub_view = frame(intersection);
-            cv::Mat rotated_sub_view = rotated_image(cv::Rect(intersection.x - roi.x, intersection.y - roi.y, intersection.width, intersection.height));
-
-            for (int r = 0; r < intersection.height; ++r) {
-                for (int c = 0; c < intersection.width; ++c) {
-                    cv::Vec4b& frame_pixel = frame_sub_view.at<cv::Vec4b>(r, c);
-                    cv::Vec4b& rotated_pixel = rotated_sub_view.at<cv::Vec4b>(r, c);
-
-                    if (rotated_pixel[3] == 0) continue;
 
-                    double alpha_rotated = rotated_pixel[3] / 255.0;
-                    double alpha_frame = frame_pixel[3] / 255.0;
-                    double new_alpha = alpha_rotated + alpha_frame * (1 - alpha_rotated);
-
-                    if (new_alpha > 0) {
-                        for (int k = 0; k < 3; ++k) {
-                            frame_pixel[k] = static_cast<uchar>((rotated_pixel[k] * alpha_rotated + frame_pixel[k] * alpha_frame * (1 - alpha_rotated)) / new_alpha);
-                        }
-                        frame_pixel[3] = static_cast<uchar>(new_alpha * 255);
-                    }
-                }
-            }
-            current_layer_scale *= m_settings.scale_decay;
-        }
-        
-        // Apply Vignette effect
-        if (m_settings.vignette_strength > 0.0) {
-            cv::Mat vignette_mask(height, width, CV_32FC1);
-            cv::Point2f center(width / 2.0F, height / 2.0F);
-            double max_dist = std::sqrt(center.x * center.x + center.y * center.y);
-
-            for (int r = 0; r < height; ++r) {
-                for (int c = 0; c < width; ++c) {
-                    double dist = cv::norm(cv::Point2f(c, r) - center);
-                    double normalized_dist = dist / max_dist;
-                    // Apply a power function to the normalized distance for a smoother falloff
-                    double vignette_value = 1.0 - m_settings.vignette_strength * std::pow(normalized_dist, 2.0);
-                    vignette_mask.at<float>(r, c) = static_cast<float>(std::max(0.0, std::min(1.0, vignette_value)));
-                }
-            }
-
-            for (int r = 0; r < height; ++r) {
-                for (int c = 0; c < width; ++c) {
-                    cv::Vec4b& pixel = frame.at<cv::Vec4b>(r, c);
-                    float mask_val = vignette_mask.at<float>(r, c);
-                    for (int k = 0; k < 3; ++k) { // Apply to B, G, R channels
-                        pixel[k] = static_cast<uchar>(pixel[k] * mask_val);
-                    }
-                }
-            }
-        }
-
-        double global_scale = 1.0;
-        if (m_settings.global_zoom_mode == "Linear") {
-            global_scale = 1.0 + (m_settings.linear_zoom_speed * frame_progress);
-        } else if (m_settings.global_zoom_mode == "Oscillating") {
-            double sine_wave = sin(frame_progress * 2.0 * M_PI * m_settings.oscillating_zoom_frequency);
-            double zoom_center = m_settings.oscillating_zoom_midpoint;
-            global_scale = zoom_center + (m_settings.oscillating_zoom_amplitude * sine_wave);
-        }
-
-        if (global_scale != 1.0) {
-            cv::Mat zoom_matrix = cv::getRotationMatrix2D(cv::Point2f(width / 2.0f, height / 2.0f), 0.0, global_scale);
-            // --- THIS IS THE CHANGED LINE ---
-            cv::warpAffine(frame, frame, zoom_matrix, frame.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
-        }
-
-        if (m_settings.pixelation_level > 1) {
-            cv::Mat small_img;
-            cv::resize(frame, small_img, cv::Size(width / m_settings.pixelation_level, height / m_settings.pixelation_level), 0, 0, cv::INTER_NEAREST);
-            cv::resize(small_img, frame, cv::Size(width, height), 0, 0, cv::INTER_NEAREST);
-        }
-
-        if (m_settings.wave_amplitude > 0.0 && m_settings.wave_frequency > 0.0 && m_settings.wave_direction != "None") {
-            cv::Mat map_x(height, width, CV_32FC1), map_y(height, width, CV_32FC1), distorted_frame;
-            for (int r = 0; r < height; ++r) {
-                for (int c = 0; c < width; ++c) {
-                    if (m_settings.wave_direction == "Horizontal") {
-                        map_x.at<float>(r, c) = static_cast<float>(c + m_settings.wave_amplitude * std::sin(r * m_settings.wave_frequency + i * 0.1));
-                        map_y.at<float>(r, c) = static_cast<float>(r);
-                    } else if (m_settings.wave_direction == "Vertical") {
-                        map_x.at<float>(r, c) = static_cast<float>(c);
-                        map_y.at<float>(r, c) = static_cast<float>(r + m_settings.wave_amplitude * std::sin(c * m_settings.wave_frequency + i * 0.1));
-                    } else {
-                        map_x.at<float>(r, c) = static_cast<float>(c);
-                        map_y.at<float>(r, c) = static_cast<float>(r);
-                    }
-                }
+    // Frames do not depend on each other, so a window of them renders in
+    // parallel while gif-h, which encodes each frame against the previous
+    // one, writes them in order.
+    int window_size = std::max(1, std::min(cv::getNumThreads(), m_settings.num_frames));
+    std::vector<cv::Mat> window(window_size);
+    for (cv::Mat& frame : window) {
+        frame.create(height, width, CV_8UC4);
+    }
+    m_frame_checksums.clear();
+    StageProfile* profile = m_profile.get();
+
+    for (int window_start = 0; window_start < m_settings.num_frames; window_start += window_size) {
+        if (isCancelled()) { qDebug() << "Worker: Cancellation requested."; break; }
+        int window_frames = std::min(window_size, m_settings.num_frames - window_start);
+
+        cv::parallel_for_(cv::Range(0, window_frames), [&](const cv::Range& range) {
+            StageProfileScope thread_profile_scope(profile);
+            for (int w = range.start; w < range.end; ++w) {
+                std::chrono::steady_clock::time_point render_start = std::chrono::steady_clock::now();
+                renderer.renderFrame(window_start + w, window[w], FrameOutputFormat::RGBA);
+                m_progress->frameRendered(std::chrono::steady_clock::now() - render_start);
             }
-            cv::remap(frame, distorted_frame, map_x, map_y, cv::INTER_LINEAR, cv::BORDER_REPLICATE);
-            frame = distorted_frame;
-        }
-
-        if (m_settings.hue_speed > 0 && m_settings.hue_intensity > 0) {
-            cv::Mat hsv_frame, temp_bgr;
-            cv::cvtColor(frame, temp_bgr, cv::COLOR_BGRA2BGR);
-            cv::cvtColor(temp_bgr, hsv_frame, cv::COLOR_BGR2HSV);
-
-            double saturation_pulse = sin(frame_progress * 2.0 * M_PI * (m_settings.hue_speed / 4.0));
-            double saturation_multiplier = 1.0 + (saturation_pulse * (m_settings.hue_intensity - 1.0));
-
-            for (int r = 0; r < hsv_frame.rows; ++r) {
-                for (int c = 0; c < hsv_frame.cols; ++c) {
-                    auto& pixel = hsv_frame.at<cv::Vec3b>(r, c);
-                    pixel[0] = static_cast<uchar>(std::fmod((pixel[0] + (i * m_settings.hue_speed)), 180.0));
-                    pixel[1] = cv::saturate_cast<uchar>(pixel[1] * saturation_multiplier);
-                }
+        });
+
+        for (int w = 0; w < window_frames; ++w) {
+            std::chrono::steady_clock::time_point encode_start = std::chrono::steady_clock::now();
+            if (m_record_checksums) m_frame_checksums.push_back(frameChecksum(window[w]));
+            if (!encoder.writeFrame(window[w])) {
+                emit finished(false, "Error: Failed to write frame to GIF.");
+                encoder.end();
+                return;
             }
-            cv::cvtColor(hsv_frame, temp_bgr, cv::COLOR_HSV2BGR);
-            cv::cvtColor(temp_bgr, frame, cv::COLOR_BGR2BGRA);
-        }
-
-        if (m_settings.color_invert_frequency > 0 && (i % m_settings.color_invert_frequency == 0)) {
-            cv::Mat bgr_frame;
-            cv::cvtColor(frame, bgr_frame, cv::COLOR_BGRA2BGR);
-            cv::bitwise_not(bgr_frame, bgr_frame);
-            cv::cvtColor(bgr_frame, frame, cv::COLOR_BGR2BGRA);
-        }
-
-        if (m_settings.blur_radius > 0) {
-            cv::GaussianBlur(frame, frame, cv::Size(0, 0), m_settings.blur_radius);
-        }
-        
-        cv::cvtColor(frame, frame, cv::COLOR_BGRA2RGBA);
-        if (!GifWriteFrame(&writer, frame.data, width, height, frame_delay_cs)) {
-            emit finished(false, "Error: Failed to write frame to GIF.");
-            GifEnd(&writer);
-            return;
+            m_progress->frameEncoded(std::chrono::steady_clock::now() - encode_start, encoder.bytesWritten());
         }
     }
 
-    GifEnd(&writer);
-    if (m_isCancelled) {
+    encoder.end();
+    if (isCancelled()) {
         emit finished(false, "GIF generation cancelled.");
     } else {
+        if (m_cache) {
+            if (cache_key.isEmpty()) cache_key = RenderCache::key(m_source_digest, render_settings);
+            m_cache->store(cache_key, QString::fromStdString(m_output_path), CachedRender{m_seed, m_frame_checksums});
+        }
         emit finished(true, QString::fromStdString(m_output_path));
     }
 }
\ No newline at end of file
@@ -2,22 +2,67 @@
 #ifndef GIF_WORKER_H
 #define GIF_WORKER_H
 
+#include <QByteArray>
 #include <QObject>
 #include <string>
 #include <functional>
 #include <atomic> // Required for std::atomic
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <opencv2/opencv.hpp>
 #include "gif_settings.h"
 
+class RenderStageCache;
+class StageProfile;
+class RenderProgress;
+class RenderCache;
+
 class GifWorker : public QObject
 {
     Q_OBJECT
 
 public:
-    explicit GifWorker(const GifSettings& settings, const std::string& output_path);
+    // `working_source` may carry the image already loaded at GIF_WORKING_SIZE,
+    // e.g. by the GUI's background preparation; otherwise it is loaded here.
+    // Workers rendering the same source can share `stage_cache`.
+    explicit GifWorker(const GifSettings& settings, const std::string& output_path,
+                       const cv::Mat& working_source = cv::Mat(),
+                       std::shared_ptr<RenderStageCache> stage_cache = nullptr);
     ~GifWorker() override = default;
 
+    // Stage timings of the last process() call. Callers that time work of
+    // their own for this job, such as loading the source, may pass the
+    // profile they recorded it in; otherwise the worker keeps its own.
+    void setStageProfile(std::shared_ptr<StageProfile> profile);
+    std::shared_ptr<const StageProfile> stageProfile() const { return m_profile; }
+
+    // Live progress of process(); sample it from any thread, e.g. on a timer.
+    std::shared_ptr<const RenderProgress> progress() const { return m_progress; }
+    // Also stop when `*cancel_flag` becomes true, e.g. a batch-wide flag.
+    void setCancelFlag(const std::atomic<bool>* cancel_flag) { m_cancel_flag = cancel_flag; }
+
+    // Seed the starfield was rendered with: settings.seed, or the one drawn
+    // for this render when that is 0. Rendering again with it as
+    // settings.seed reproduces the GIF exactly.
+    int seed() const { return m_seed; }
+
+    // Records frameChecksum() of every frame written, in order.
+    void setRecordChecksums(bool record) { m_record_checksums = record; }
+    const std::vector<std::uint64_t>& frameChecksums() const { return m_frame_checksums; }
+
+    // Looks the job up in `cache` before rendering, and stores the GIF
+    // there after a successful render. Callers that already hashed the
+    // source to check the cache pass its RenderCache::sourceDigest() so it
+    // is not hashed again.
+    void setRenderCache(std::shared_ptr<RenderCache> cache, const QByteArray& source_digest = QByteArray()) {
+        m_cache = std::move(cache);
+        m_source_digest = source_digest;
+    }
+    // Whether the last process() copied the GIF from the cache.
+    bool cacheHit() const { return m_cache_hit; }
+
 signals:
-    void progressUpdated(int percentage, const QString& message);
     void finished(bool success, const QString& pathOrMessage);
 
 public slots:
@@ -27,9 +72,21 @@ public slots:
 private:
     GifSettings m_settings;
     std::string m_output_path;
+    cv::Mat m_working_source;
+    std::shared_ptr<RenderStageCache> m_stage_cache;
+    std::shared_ptr<StageProfile> m_profile;
+    std::shared_ptr<RenderProgress> m_progress;
+    const std::atomic<bool>* m_cancel_flag = nullptr;
+    int m_seed = 0;
+    bool m_record_checksums = false;
+    std::vector<std::uint64_t> m_frame_checksums;
+    std::shared_ptr<RenderCache> m_cache;
+    QByteArray m_source_digest;
+    bool m_cache_hit = false;
     std::atomic<bool> m_isCancelled{false}; // Thread-safe cancellation flag
 
-    void emitProgress(int percentage, const std::string& message);
+    bool isCancelled() const { return m_isCancelled || (m_cancel_flag && *m_cancel_flag); }
+    bool fetchFromCache(const QString& cache_key);
 };
 
 #endif // GIF_WORKER_H
\ No newline at end of file
@@ -1,9 +1,11 @@
 // main.cpp (GUI Entry Point)
 #include <QApplication>
 #include "mainwindow.h"
+#include "mat_pool.h"
 
 int main(int argc, char *argv[]) {
     QApplication app(argc, argv);
+    installPooledMatAllocator();
 
     // --- GLOBAL STYLESHEET ---
     QString styleSheet = R"(
@@ -0,0 +1,416 @@
+// main_cli.cpp (Command-Line Entry Point)
+//
+// Renders a GIF without a GUI, using the same GifWorker as the desktop app.
+// Progress and results are printed to stdout as one JSON object per line.
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QThread>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonParseError>
+#include <QFileInfo>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include "gif_settings.h"
+#include "gif_settings_json.h"
+#include "gif_worker.h"
+#include "frame_renderer.h"
+#include "batch_runner.h"
+#include "mat_pool.h"
+#include "render_cache.h"
+#include "render_progress.h"
+#include "stage_timer.h"
+
+namespace {
+
+// Process exit status, also reported as "status" in the final JSON line.
+enum ExitStatus {
+    ExitOk = 0,
+    ExitUsage = 1,         // Bad command line
+    ExitBadSettings = 2,   // Settings file unreadable or invalid
+    ExitInputError = 3,    // Input image could not be loaded
+    ExitRenderError = 4,   // Rendering or writing the GIF failed
+    ExitCancelled = 5,     // Interrupted by SIGINT/SIGTERM
+    ExitBatchFailures = 6  // Batch finished, but some jobs failed
+};
+
+const int DEFAULT_MEMORY_BUDGET_MB = 2048;
+const int PROGRESS_INTERVAL_MS = 500;
+
+const char* statusName(ExitStatus status) {
+    switch (status) {
+    case ExitOk: return "ok";
+    case ExitUsage: return "usage_error";
+    case ExitBadSettings: return "bad_settings";
+    case ExitInputError: return "input_error";
+    case ExitRenderError: return "render_error";
+    case ExitCancelled: return "cancelled";
+    case ExitBatchFailures: return "batch_failures";
+    }
+    return "unknown";
+}
+
+std::atomic<GifWorker*> g_active_worker{nullptr};
+std::atomic<bool> g_interrupted{false};
+
+void handleInterrupt(int) {
+    g_interrupted = true;
+    if (GifWorker* worker = g_active_worker.load()) worker->cancel();
+}
+
+void printJsonLine(const QJsonObject& object) {
+    QByteArray line = QJsonDocument(object).toJson(QJsonDocument::Compact);
+    std::fwrite(line.constData(), 1, static_cast<size_t>(line.size()), stdout);
+    std::fputc('\n', stdout);
+    std::fflush(stdout);
+}
+
+void printProgress(const RenderProgress::Snapshot& progress) {
+    printJsonLine(QJsonObject{
+        {"event", "progress"},
+        {"frame", progress.frames_encoded},
+        {"frames", progress.total_frames},
+        {"percent", progress.percent()},
+        {"fps", progress.framesPerSecond()},
+        {"eta_s", progress.etaSecs()},
+        {"bytes_written", static_cast<qint64>(progress.bytes_written)},
+        {"avg_render_ms", progress.avg_render_msecs},
+        {"avg_encode_ms", progress.avg_encode_msecs},
+        {"elapsed_ms", static_cast<qint64>(progress.elapsed_secs * 1000.0)}});
+}
+
+int fail(ExitStatus status, const QString& message) {
+    printJsonLine(QJsonObject{{"event", "error"}, {"status", statusName(status)}, {"message", message}});
+    return status;
+}
+
+bool loadSettingsFile(const QString& path, GifSettings& settings, QString* error) {
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        *error = QString("Cannot open settings file '%1'.").arg(path);
+        return false;
+    }
+    QJsonParseError parse_error;
+    QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &parse_error);
+    if (!document.isObject()) {
+        *error = QString("Settings file '%1' is not a JSON object: %2").arg(path, parse_error.errorString());
+        return false;
+    }
+    return settingsFromJson(document.object(), settings, error);
+}
+
+QString checksumHex(std::uint64_t checksum) {
+    return QString("%1").arg(static_cast<qulonglong>(checksum), 16, 16, QChar('0'));
+}
+
+// One job's entry in a --checksums manifest. `settings` carries the seed
+// actually used, so the entry alone is enough to reproduce the frames.
+QJsonObject checksumEntry(const GifSettings& settings, const std::string& output_path,
+                          const std::vector<std::uint64_t>& frame_checksums) {
+    QJsonArray frames;
+    for (std::uint64_t checksum : frame_checksums) {
+        frames.append(checksumHex(checksum));
+    }
+    return QJsonObject{
+        {"output", QString::fromStdString(output_path)},
+        {"settings", settingsToJson(settings)},
+        {"checksum", checksumHex(combineChecksums(frame_checksums))},
+        {"frames", frames}};
+}
+
+bool writeJsonFile(const QString& path, const QJsonObject& object, QString* error) {
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *error = QString("Cannot write '%1'.").arg(path);
+        return false;
+    }
+    file.write(QJsonDocument(object).toJson(QJsonDocument::Indented));
+    return true;
+}
+
+// Runs a batch manifest, or a sweep of one image when `sweep` is set.
+int runBatch(const QString& manifest_path, bool sweep, const GifSettings& base_settings, int parallel_jobs,
+             qint64 memory_budget_bytes, const QString& report_path, const QString& trace_path,
+             const QString& checksums_path, const std::shared_ptr<RenderCache>& cache, bool quiet) {
+    std::vector<BatchJob> jobs;
+    QString error;
+    bool loaded = sweep ? loadSweepManifest(manifest_path, base_settings, jobs, &error)
+                        : loadBatchManifest(manifest_path, base_settings, jobs, &error);
+    if (!loaded) {
+        return fail(ExitBadSettings, error);
+    }
+    if (sweep && !prepareSharedSource(jobs)) {
+        return fail(ExitInputError, QString("Could not load input image '%1'.").arg(QString::fromStdString(jobs.front().settings.image_path)));
+    }
+    if (!quiet) {
+        printJsonLine(QJsonObject{
+            {"event", "batch_start"},
+            {"jobs", static_cast<int>(jobs.size())},
+            {"parallel_jobs", parallel_jobs},
+            {"memory_budget_mb", memory_budget_bytes / (1024 * 1024)}});
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+    BatchRunner runner(parallel_jobs, memory_budget_bytes);
+    runner.setRecordChecksums(!checksums_path.isEmpty());
+    runner.setRenderCache(cache);
+    std::vector<BatchJobResult> results = runner.run(jobs, [quiet](const BatchJobResult& result) {
+        if (quiet) return;
+        QJsonObject line = result.toJson();
+        line.insert("event", "job");
+        printJsonLine(line);
+    }, &g_interrupted);
+    qint64 wall_msecs = timer.elapsed();
+
+    int succeeded = 0;
+    QJsonArray report;
+    for (const BatchJobResult& result : results) {
+        if (result.succeeded()) ++succeeded;
+        report.append(result.toJson());
+    }
+    if (!report_path.isEmpty()) {
+        QFile report_file(report_path);
+        if (!report_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+            return fail(ExitUsage, QString("Cannot write report '%1'.").arg(report_path));
+        }
+        report_file.write(QJsonDocument(report).toJson(QJsonDocument::Indented));
+    }
+    if (!trace_path.isEmpty()) {
+        std::vector<const StageProfile*> profiles;
+        for (const BatchJobResult& result : results) {
+            profiles.push_back(result.profile.get());
+        }
+        if (!writeChromeTrace(trace_path, profiles, &error)) return fail(ExitUsage, error);
+    }
+    if (!checksums_path.isEmpty()) {
+        QJsonArray entries;
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (!results[i].succeeded()) continue;
+            GifSettings settings = jobs[i].settings;
+            settings.seed = results[i].seed;
+            entries.append(checksumEntry(settings, results[i].output_path, results[i].frame_checksums));
+        }
+        if (!writeJsonFile(checksums_path, QJsonObject{{"jobs", entries}}, &error)) return fail(ExitUsage, error);
+    }
+
+    ExitStatus status = ExitOk;
+    if (g_interrupted) {
+        status = ExitCancelled;
+    } else if (succeeded < static_cast<int>(results.size())) {
+        status = ExitBatchFailures;
+    }
+    double gifs_per_minute = wall_msecs > 0 ? succeeded * 60000.0 / wall_msecs : 0.0;
+    printJsonLine(QJsonObject{
+        {"event", "batch_done"},
+        {"status", statusName(status)},
+        {"jobs", static_cast<int>(results.size())},
+        {"succeeded", succeeded},
+        {"failed", static_cast<int>(results.size()) - succeeded},
+        {"wall_ms", wall_msecs},
+        {"gifs_per_minute", gifs_per_minute}});
+    return status;
+}
+
+} // namespace
+
+int main(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("gif_creator_cli");
+    installPooledMatAllocator();
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Renders a psychedelic GIF from an image without the GUI.");
+    parser.addHelpOption();
+    QCommandLineOption settingsOption({"s", "settings"}, "Read settings from a JSON file.", "file");
+    QCommandLineOption setOption("set", "Override one setting, e.g. --set num_frames=90. May be repeated.", "key=value");
+    QCommandLineOption printSettingsOption("print-settings", "Print the effective settings as JSON and exit.");
+    QCommandLineOption quietOption({"q", "quiet"}, "Only print the final result line.");
+    QCommandLineOption batchOption("batch", "Render every job in a JSON manifest instead of a single GIF.", "manifest");
+    QCommandLineOption sweepOption("sweep", "Render one image under every settings variant in a JSON sweep file.", "sweep");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Batch jobs to run at once. Defaults to the number of cores.", "count");
+    QCommandLineOption memoryBudgetOption("memory-budget", "Memory the running batch jobs may use, in MB.", "mb",
+                                          QString::number(DEFAULT_MEMORY_BUDGET_MB));
+    QCommandLineOption reportOption("report", "Write the per-job batch results to a JSON file.", "file");
+    QCommandLineOption traceOption("trace", "Write per-stage timings as a Chrome trace_event JSON file.", "file");
+    QCommandLineOption seedOption("seed", "Seed for the random starfield; the same seed renders the same GIF.", "seed");
+    QCommandLineOption checksumsOption("checksums", "Write a 64-bit checksum of every frame to a JSON file.", "file");
+    QCommandLineOption cacheDirOption("cache-dir", "Directory of the render cache.", "dir", RenderCache::defaultDirectory());
+    QCommandLineOption cacheSizeOption("cache-size", "Size the render cache is trimmed to, in MB.", "mb",
+                                       QString::number(RenderCache::DEFAULT_MAX_BYTES / (1024 * 1024)));
+    QCommandLineOption noCacheOption("no-cache", "Always render; neither read nor fill the render cache.");
+    parser.addOption(settingsOption);
+    parser.addOption(setOption);
+    parser.addOption(printSettingsOption);
+    parser.addOption(quietOption);
+    parser.addOption(batchOption);
+    parser.addOption(sweepOption);
+    parser.addOption(jobsOption);
+    parser.addOption(memoryBudgetOption);
+    parser.addOption(reportOption);
+    parser.addOption(traceOption);
+    parser.addOption(seedOption);
+    parser.addOption(checksumsOption);
+    parser.addOption(cacheDirOption);
+    parser.addOption(cacheSizeOption);
+    parser.addOption(noCacheOption);
+    parser.addPositionalArgument("input", "Input image. Defaults to image_path from the settings.");
+    parser.addPositionalArgument("output", "Output GIF path.");
+    parser.process(app);
+
+    GifSettings settings = GifSettings::getDefaultSettings();
+    QString error;
+    if (parser.isSet(settingsOption) && !loadSettingsFile(parser.value(settingsOption), settings, &error)) {
+        return fail(ExitBadSettings, error);
+    }
+    for (const QString& assignment : parser.values(setOption)) {
+        if (!applySettingOverride(assignment, settings, &error)) return fail(ExitBadSettings, error);
+    }
+    if (parser.isSet(seedOption) && !applySettingOverride("seed=" + parser.value(seedOption), settings, &error)) {
+        return fail(ExitBadSettings, error);
+    }
+
+    bool quiet = parser.isSet(quietOption);
+    std::signal(SIGINT, handleInterrupt);
+    std::signal(SIGTERM, handleInterrupt);
+
+    std::shared_ptr<RenderCache> cache;
+    if (!parser.isSet(noCacheOption)) {
+        bool ok = true;
+        qint64 cache_size_mb = parser.value(cacheSizeOption).toLongLong(&ok);
+        if (!ok || cache_size_mb < 1) return fail(ExitUsage, "--cache-size must be a positive number of MB.");
+        cache = std::make_shared<RenderCache>(parser.value(cacheDirOption), cache_size_mb * 1024 * 1024);
+    }
+
+    if (parser.isSet(batchOption) || parser.isSet(sweepOption)) {
+        if (parser.isSet(batchOption) && parser.isSet(sweepOption)) return fail(ExitUsage, "Use either --batch or --sweep, not both.");
+        bool ok = true;
+        int parallel_jobs = parser.isSet(jobsOption) ? parser.value(jobsOption).toInt(&ok) : QThread::idealThreadCount();
+        if (!ok || parallel_jobs < 1) return fail(ExitUsage, "--jobs must be a positive number.");
+        qint64 memory_budget_mb = parser.value(memoryBudgetOption).toLongLong(&ok);
+        if (!ok || memory_budget_mb < 1) return fail(ExitUsage, "--memory-budget must be a positive number of MB.");
+        bool sweep = parser.isSet(sweepOption);
+        return runBatch(parser.value(sweep ? sweepOption : batchOption), sweep, settings, parallel_jobs,
+                        memory_budget_mb * 1024 * 1024, parser.value(reportOption),
+                        parser.value(traceOption), parser.value(checksumsOption), cache, quiet);
+    }
+
+    QStringList positional = parser.positionalArguments();
+    if (positional.size() == 2) {
+        settings.image_path = positional.at(0).toStdString();
+    }
+
+    if (parser.isSet(printSettingsOption)) {
+        printJsonLine(settingsToJson(settings));
+        return ExitOk;
+    }
+    if (positional.isEmpty() || positional.size() > 2) {
+        return fail(ExitUsage, "Expected [input] output. Run with --help for usage.");
+    }
+    if (settings.image_path.empty()) {
+        return fail(ExitUsage, "No input image given.");
+    }
+    QString settings_error;
+    if (!validateSettings(settings, &settings_error)) {
+        return fail(ExitBadSettings, settings_error);
+    }
+    std::string output_path = positional.last().toStdString();
+
+    std::shared_ptr<StageProfile> profile = std::make_shared<StageProfile>();
+    QElapsedTimer total_timer;
+    total_timer.start();
+    // The source is only decoded if the render cache cannot serve the GIF.
+    QByteArray source_digest = cache ? RenderCache::sourceDigest(settings.image_path) : QByteArray();
+    bool cached = cache && cache->contains(RenderCache::key(source_digest, settings));
+    cv::Mat working_source;
+    if (!cached) {
+        StageProfileScope profile_scope(profile.get());
+        working_source = loadSourceImage(settings.image_path, GIF_WORKING_SIZE, cv::INTER_LANCZOS4);
+    }
+    if (working_source.empty() && !cached) {
+        return fail(ExitInputError, QString("Could not load input image '%1'.").arg(QString::fromStdString(settings.image_path)));
+    }
+    qint64 load_msecs = total_timer.elapsed();
+
+    if (!quiet) {
+        printJsonLine(QJsonObject{
+            {"event", "start"},
+            {"input", QString::fromStdString(settings.image_path)},
+            {"output", QString::fromStdString(output_path)},
+            {"frames", settings.num_frames},
+            {"width", GIF_WORKING_SIZE},
+            {"height", GIF_WORKING_SIZE},
+            {"load_ms", load_msecs}});
+    }
+
+    // The worker renders on its own thread and signals `finished` directly
+    // from there; this thread samples its progress counters meanwhile.
+    GifWorker worker(settings, output_path, working_source);
+    worker.setStageProfile(profile);
+    worker.setRecordChecksums(parser.isSet(checksumsOption));
+    worker.setRenderCache(cache, source_digest);
+    std::shared_ptr<const RenderProgress> progress = worker.progress();
+    QElapsedTimer render_timer;
+    render_timer.start();
+    bool success = false;
+    QString result_message;
+    std::mutex done_mutex;
+    std::condition_variable done_changed;
+    bool done = false;
+    QObject::connect(&worker, &GifWorker::finished, [&](bool ok, const QString& pathOrMessage) {
+        std::lock_guard<std::mutex> lock(done_mutex);
+        success = ok;
+        result_message = pathOrMessage;
+        done = true;
+        done_changed.notify_all();
+    });
+
+    g_active_worker = &worker;
+    std::thread render_thread([&worker]() { worker.process(); });
+    {
+        std::unique_lock<std::mutex> lock(done_mutex);
+        while (!done_changed.wait_for(lock, std::chrono::milliseconds(PROGRESS_INTERVAL_MS), [&done]() { return done; })) {
+            if (!quiet) printProgress(progress->snapshot());
+        }
+    }
+    render_thread.join();
+    g_active_worker = nullptr;
+    qint64 render_msecs = render_timer.elapsed();
+
+    if (!success) {
+        return fail(g_interrupted ? ExitCancelled : ExitRenderError, result_message);
+    }
+    if (parser.isSet(traceOption) && !writeChromeTrace(parser.value(traceOption), {profile.get()}, &error)) {
+        return fail(ExitUsage, error);
+    }
+    settings.seed = worker.seed();
+    if (parser.isSet(checksumsOption) &&
+        !writeJsonFile(parser.value(checksumsOption), checksumEntry(settings, output_path, worker.frameChecksums()), &error)) {
+        return fail(ExitUsage, error);
+    }
+
+    double fps = render_msecs > 0 ? settings.num_frames * 1000.0 / render_msecs : 0.0;
+    printJsonLine(QJsonObject{
+        {"event", "done"},
+        {"status", statusName(ExitOk)},
+        {"output", result_message},
+        {"frames", settings.num_frames},
+        {"load_ms", load_msecs},
+        {"render_ms", render_msecs},
+        {"total_ms", total_timer.elapsed()},
+        {"fps", fps},
+        {"output_bytes", QFileInfo(result_message).size()},
+        {"seed", settings.seed},
+        {"cache_hit", worker.cacheHit()},
+        {"stages", profile->toJson()},
+        {"allocations", profile->allocations().toJson()}});
+    return ExitOk;
+}
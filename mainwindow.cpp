@@ -1,7 +1,12 @@
 // mainwindow.cpp
 #include "mainwindow.h"
 #include "advancedsettingsdialog.h"
+#include "chaosexplorerdialog.h"
 #include "gif_worker.h"
+#include "frame_renderer.h"
+#include "preview_frame_cache.h"
+#include "render_cache.h"
+#include "render_progress.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
@@ -12,12 +17,19 @@
 #include <QUrl>
 #include <QFileInfo>
 #include <QStyle>
+#include <QtConcurrent>
 
 #include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
 
-#ifndef M_PI
-#define M_PI 3.14159265358979323846
-#endif
+const int PREVIEW_CACHE_BUDGET_BYTES = 64 * 1024 * 1024;
+// Tunnel composites kept between GIF renders of the same source, out of the
+// RenderStageCache::MAX_TUNNEL_BYTES a render may use.
+const size_t RETAINED_TUNNEL_BYTES = size_t(64) << 20;
+const int PREVIEW_INTERACTIVE_DELAY_MS = 30;
+const int PREVIEW_IDLE_DELAY_MS = 400;
+const int GENERATION_PROGRESS_INTERVAL_MS = 200;
 
 MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),
     worker(nullptr), workerThread(nullptr)
@@ -25,14 +37,26 @@ MainWindow::MainWindow(QWidget *parent) : QMainWindow(parent),
     setWindowTitle("Psychedelic GIF Creator");
     resize(800, 800);
     currentSettings = GifSettings::getDefaultSettings();
+    renderCache = std::make_shared<RenderCache>(RenderCache::defaultDirectory());
     
     previewUpdateTimer = new QTimer(this);
     previewUpdateTimer->setSingleShot(true);
     connect(previewUpdateTimer, &QTimer::timeout, this, &MainWindow::generatePreviewFrame);
+    previewIdleTimer = new QTimer(this);
+    previewIdleTimer->setSingleShot(true);
+    connect(previewIdleTimer, &QTimer::timeout, this, &MainWindow::generateFullQualityPreview);
+    generationProgressTimer = new QTimer(this);
+    generationProgressTimer->setInterval(GENERATION_PROGRESS_INTERVAL_MS);
+    connect(generationProgressTimer, &QTimer::timeout, this, &MainWindow::updateGenerationProgress);
+    previewCache = new PreviewFrameCache(PREVIEW_CACHE_BUDGET_BYTES, this);
+    connect(previewCache, &PreviewFrameCache::frameReady, this, &MainWindow::handlePreviewFrameReady);
+    sourcePreparation = new QFutureWatcher<PreparedSource>(this);
+    connect(sourcePreparation, &QFutureWatcher<PreparedSource>::finished, this, &MainWindow::handleSourcePrepared);
 
     setupUi();
     setupConnections();
     refreshCoreSettingsUi();
+    frameScrubber->setValue(currentSettings.num_frames / 2); // Start on the frame the preview used to show
 }
 
 MainWindow::~MainWindow() {
@@ -53,6 +77,11 @@ void MainWindow::setupUi() {
     auto previewControlsLayout = new QHBoxLayout();
     previewCheckBox = new QCheckBox("Enable Real-time Preview");
     previewCheckBox->setChecked(true);
+    previewQualityLabel = new QLabel("Draft");
+    previewQualityLabel->setToolTip("The preview is drawn at reduced quality while settings change. Full quality follows when you pause.");
+    previewQualityLabel->setStyleSheet("color: #FFB74D; font-size: 8pt;");
+    previewQualityLabel->setVisible(false);
+    previewControlsLayout->addWidget(previewQualityLabel);
     previewControlsLayout->addStretch();
     previewControlsLayout->addWidget(previewCheckBox);
     mainLayout->addLayout(previewControlsLayout);
@@ -66,6 +95,19 @@ void MainWindow::setupUi() {
     mainLayout->addWidget(previewRenderLabel, 1, Qt::AlignCenter);
     m_controlsToManage.append(previewRenderLabel);
 
+    auto scrubberLayout = new QHBoxLayout();
+    auto scrubberTitleLabel = new QLabel("Frame:");
+    frameScrubber = new QSlider(Qt::Horizontal);
+    frameScrubber->setToolTip("Choose which frame of the animation the preview shows.");
+    frameScrubberLabel = new QLabel();
+    frameScrubberLabel->setFixedWidth(80);
+    scrubberLayout->addWidget(scrubberTitleLabel);
+    scrubberLayout->addWidget(frameScrubber, 1);
+    scrubberLayout->addWidget(frameScrubberLabel);
+    mainLayout->addLayout(scrubberLayout);
+    m_controlsToManage.append(scrubberTitleLabel);
+    m_controlsToManage.append(frameScrubber);
+
 
     auto inputGroup = new QGroupBox("Input Artifact");
     auto pathLayout = new QHBoxLayout(inputGroup);
@@ -108,6 +150,18 @@ void MainWindow::setupUi() {
     scaleDecaySlider->setRange(50, 99); scaleDecaySpinBox->setRange(0.50, 0.99);
     scaleDecaySpinBox->setSingleStep(0.01); scaleDecaySpinBox->setDecimals(2);
 
+    QString tunnelModeTip = "Layered draws every layer separately. Feedback nests each layer in the last, turned a step further, at the same cost however many layers.";
+    auto tunnelModeLabel = new QLabel("Tunnel:");
+    tunnelModeLabel->setToolTip(tunnelModeTip);
+    coreLayout->addWidget(tunnelModeLabel, row, 0);
+    tunnelModeCombo = new QComboBox();
+    for (const std::string& name : enumNames(TunnelMode())) tunnelModeCombo->addItem(QString::fromStdString(name));
+    tunnelModeCombo->setToolTip(tunnelModeTip);
+    coreLayout->addWidget(tunnelModeCombo, row, 1, 1, 2);
+    m_controlsToManage.append(tunnelModeLabel);
+    m_controlsToManage.append(tunnelModeCombo);
+    row++;
+
     hueSpeedSpinBox = new QDoubleSpinBox();
     createSliderRow("Pulse Speed:", hueSpeedSlider, reinterpret_cast<QWidget*&>(hueSpeedSpinBox), "Controls the speed of the color shifting effect.");
     hueSpeedSlider->setRange(0, 200); hueSpeedSpinBox->setRange(0.0, 20.0);
@@ -126,7 +180,7 @@ void MainWindow::setupUi() {
     auto spinDirLabel = new QLabel("Spin Dir:");
     coreLayout->addWidget(spinDirLabel, row, 0);
     rotationDirectionCombo = new QComboBox();
-    rotationDirectionCombo->addItems({"Clockwise", "Counter-Clockwise", "None"});
+    for (const std::string& name : enumNames(RotationDirection())) rotationDirectionCombo->addItem(QString::fromStdString(name));
     coreLayout->addWidget(rotationDirectionCombo, row, 1, 1, 2);
     m_controlsToManage.append(spinDirLabel);
     m_controlsToManage.append(rotationDirectionCombo);
@@ -135,7 +189,7 @@ void MainWindow::setupUi() {
     auto zoomModeLabel = new QLabel("Zoom Mode:");
     coreLayout->addWidget(zoomModeLabel, row, 0);
     zoomModeComboBox = new QComboBox();
-    zoomModeComboBox->addItems({"Oscillating", "Linear", "None"});
+    for (const std::string& name : enumNames(GlobalZoomMode())) zoomModeComboBox->addItem(QString::fromStdString(name));
     coreLayout->addWidget(zoomModeComboBox, row, 1, 1, 2);
     m_controlsToManage.append(zoomModeLabel);
     m_controlsToManage.append(zoomModeComboBox);
@@ -204,6 +258,9 @@ void MainWindow::setupUi() {
     auto actionLayout = new QHBoxLayout();
     advancedButton = new QPushButton("Advanced Settings");
     actionLayout->addWidget(advancedButton);
+    chaosExplorerButton = new QPushButton("Chaos Explorer");
+    chaosExplorerButton->setToolTip("Compare a grid of random configurations and pick one.");
+    actionLayout->addWidget(chaosExplorerButton);
     actionLayout->addStretch();
     cancelButton = new QPushButton("Cancel");
     cancelButton->setVisible(false);
@@ -213,6 +270,7 @@ void MainWindow::setupUi() {
     actionLayout->addWidget(generateButton);
     mainLayout->addLayout(actionLayout);
     m_controlsToManage.append(advancedButton);
+    m_controlsToManage.append(chaosExplorerButton);
     m_controlsToManage.append(generateButton);
 
     progressBar = new QProgressBar();
@@ -223,17 +281,24 @@ void MainWindow::setupUi() {
 void MainWindow::setupConnections() {
     connect(browseButton, &QPushButton::clicked, this, &MainWindow::browseImage);
     connect(advancedButton, &QPushButton::clicked, this, &MainWindow::openAdvancedSettings);
+    connect(chaosExplorerButton, &QPushButton::clicked, this, &MainWindow::openChaosExplorer);
     connect(generateButton, &QPushButton::clicked, this, &MainWindow::startGifGeneration);
+    connect(frameScrubber, &QSlider::valueChanged, this, &MainWindow::scrubPreviewFrame);
     
     // Connect controls to the preview update trigger
     connect(previewCheckBox, &QCheckBox::toggled, this, &MainWindow::triggerPreviewUpdate);
     connect(rotationDirectionCombo, &QComboBox::currentTextChanged, this, &MainWindow::triggerPreviewUpdate);
+    connect(tunnelModeCombo, &QComboBox::currentTextChanged, this, [this](const QString& text) {
+        parseEnum(text.toStdString(), currentSettings.tunnel_mode);
+        triggerPreviewUpdate();
+    });
     connect(zoomModeComboBox, &QComboBox::currentTextChanged, this, &MainWindow::triggerPreviewUpdate);
     connect(zoomModeComboBox, &QComboBox::currentTextChanged, this, &MainWindow::on_zoomModeComboBox_currentIndexChanged);
     connect(numFramesSlider, &QSlider::valueChanged, numFramesSpinBox, &QSpinBox::setValue);
     connect(numFramesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), numFramesSlider, &QSlider::setValue);
     connect(numFramesSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int val){ 
         currentSettings.num_frames = val; 
+        updateFrameScrubberRange();
         triggerPreviewUpdate();
     });
     
@@ -271,11 +336,46 @@ void MainWindow::browseImage() {
     
     imagePathEdit->setText(filePath);
     currentSettings.image_path = filePath.toStdString();
+    previewSourcePath.clear(); // Reload even if the same file was picked again
     
     showStaticPreview();
+    startSourcePreparation();
+}
+
+void MainWindow::startSourcePreparation() {
+    // The preview waits for this job instead of decoding the image itself;
+    // handleSourcePrepared() renders the first frame once it is done.
+    preparingSourcePath = currentSettings.image_path;
+    std::string path = preparingSourcePath;
+    int preview_size = previewCheckBox->isChecked() ? previewRenderSize() : 0;
+    sourcePreparation->setFuture(QtConcurrent::run([path, preview_size]() {
+        return prepareSource(path, preview_size);
+    }));
+}
+
+void MainWindow::handleSourcePrepared() {
+    if (preparingSourcePath.empty()) return; // Already adopted by loadPreviewSource()
+
+    PreparedSource prepared = sourcePreparation->result();
+    if (prepared.path != preparingSourcePath) return; // Superseded by another pick
+    adoptPreparedSource(prepared);
     triggerPreviewUpdate();
 }
 
+void MainWindow::adoptPreparedSource(const PreparedSource& prepared) {
+    preparingSourcePath.clear();
+    if (prepared.path != currentSettings.image_path || prepared.working.empty()) return;
+
+    previewWorkingSource = prepared.working;
+    workingStageCache = prepared.stages;
+    previewSourcePath = prepared.path;
+    previewSourceSize = 0;
+    if (!prepared.preview.empty() && prepared.preview.cols == previewRenderSize()) {
+        previewCache->setSource(prepared.preview, previewRenderLabel->devicePixelRatioF());
+        previewSourceSize = prepared.preview.cols;
+    }
+}
+
 void MainWindow::openAdvancedSettings() {
     AdvancedSettingsDialog advDialog(&currentSettings, this);
     connect(&advDialog, &AdvancedSettingsDialog::settingsChanged, this, &MainWindow::refreshCoreSettingsUi);
@@ -283,6 +383,17 @@ void MainWindow::openAdvancedSettings() {
     advDialog.exec();
 }
 
+void MainWindow::openChaosExplorer() {
+    if (currentSettings.image_path.empty()) { QMessageBox::warning(this, "Input Required", "Please select an input image first."); return; }
+    if (!loadPreviewSource()) { QMessageBox::warning(this, "Image Error", "Could not load the selected image."); return; }
+
+    ChaosExplorerDialog explorer(currentSettings, previewWorkingSource, this);
+    if (explorer.exec() != QDialog::Accepted) return;
+    currentSettings = explorer.selectedSettings();
+    refreshCoreSettingsUi();
+    triggerPreviewUpdate();
+}
+
 void MainWindow::startGifGeneration() {
     if (workerThread) { return; }
     if (currentSettings.image_path.empty()) { QMessageBox::warning(this, "Input Required", "Please select an input image first."); return; }
@@ -293,24 +404,55 @@ void MainWindow::startGifGeneration() {
     cancelButton->setVisible(true);
     statusBar()->showMessage("Launching Hyperspace...", 0);
     progressBar->setValue(0);
+    progressBar->setFormat("%p%");
+    // Hand the worker the source prepared in the background, if there is
+    // one, so it does not decode the image again. Its stage cache outlives
+    // the render, so generating again after a colour tweak reuses the
+    // pyramid, layers and tunnel composites.
+    cv::Mat working_source;
+    std::shared_ptr<RenderStageCache> stage_cache;
+    if (previewSourcePath == currentSettings.image_path || preparingSourcePath == currentSettings.image_path) {
+        if (loadPreviewSource()) {
+            working_source = previewWorkingSource;
+            stage_cache = workingStageCache;
+        }
+    }
     workerThread = new QThread(this);
-    worker = new GifWorker(currentSettings, outputFilePath.toStdString());
+    worker = new GifWorker(currentSettings, outputFilePath.toStdString(), working_source, stage_cache);
+    worker->setRenderCache(renderCache);
     worker->moveToThread(workerThread);
     connect(worker, &GifWorker::finished, workerThread, &QThread::quit);
     connect(workerThread, &QThread::finished, this, [this](){ worker->deleteLater(); workerThread->deleteLater(); worker = nullptr; workerThread = nullptr; });
     connect(workerThread, &QThread::started, worker, &GifWorker::process);
-    connect(worker, &GifWorker::progressUpdated, this, &MainWindow::handleGenerationProgress);
     connect(worker, &GifWorker::finished, this, &MainWindow::handleGenerationFinished);
     connect(cancelButton, &QPushButton::clicked, worker, &GifWorker::cancel, Qt::DirectConnection);
+    generationProgress = worker->progress();
+    generationProgressTimer->start();
     workerThread->start();
 }
 
-void MainWindow::handleGenerationProgress(int percentage, const QString& message) {
-    progressBar->setValue(percentage);
-    progressBar->setFormat(message + " (%p%)");
+void MainWindow::updateGenerationProgress() {
+    if (!generationProgress) return;
+    RenderProgress::Snapshot progress = generationProgress->snapshot();
+    progressBar->setValue(progress.percent());
+    if (progress.frames_encoded == 0) return;
+
+    QString format = QString("Frame %1/%2 | %3 fps | %4 KB")
+                         .arg(progress.frames_encoded)
+                         .arg(progress.total_frames)
+                         .arg(progress.framesPerSecond(), 0, 'f', 1)
+                         .arg(progress.bytes_written / 1024);
+    if (progress.frames_encoded < progress.total_frames) {
+        format += QString(" | %1 s left").arg(static_cast<int>(std::ceil(progress.etaSecs())));
+    }
+    progressBar->setFormat(format);
 }
 
 void MainWindow::handleGenerationFinished(bool success, const QString& pathOrMessage) {
+    generationProgressTimer->stop();
+    updateGenerationProgress();
+    generationProgress.reset();
+    if (workingStageCache) workingStageCache->trimTunnels(RETAINED_TUNNEL_BYTES);
     for (QWidget* w : m_controlsToManage) { w->setEnabled(true); }
     cancelButton->setVisible(false);
     if (!success) {
@@ -342,14 +484,15 @@ void MainWindow::refreshCoreSettingsUi() {
     numFramesSpinBox->setValue(currentSettings.num_frames);
     scaleDecaySlider->setValue(static_cast<int>(currentSettings.scale_decay * 100));
     scaleDecaySpinBox->setValue(currentSettings.scale_decay);
+    tunnelModeCombo->setCurrentText(QString::fromStdString(enumName(currentSettings.tunnel_mode)));
     rotationSpeedSlider->setValue(static_cast<int>(currentSettings.rotation_speed * 10));
     rotationSpeedSpinBox->setValue(currentSettings.rotation_speed);
     hueSpeedSlider->setValue(static_cast<int>(currentSettings.hue_speed * 10));
     hueSpeedSpinBox->setValue(currentSettings.hue_speed);
     hueIntensitySlider->setValue(static_cast<int>(currentSettings.hue_intensity * 100));
     hueIntensitySpinBox->setValue(currentSettings.hue_intensity);
-    rotationDirectionCombo->setCurrentText(QString::fromStdString(currentSettings.rotation_direction));
-    zoomModeComboBox->setCurrentText(QString::fromStdString(currentSettings.global_zoom_mode));
+    rotationDirectionCombo->setCurrentText(QString::fromStdString(enumName(currentSettings.rotation_direction)));
+    zoomModeComboBox->setCurrentText(QString::fromStdString(enumName(currentSettings.global_zoom_mode)));
     linearZoomStrengthSlider->setValue(static_cast<int>(currentSettings.linear_zoom_speed * 100));
     linearZoomStrengthSpinBox->setValue(currentSettings.linear_zoom_speed);
     oscillatingZoomStrengthSlider->setValue(static_cast<int>(currentSettings.oscillating_zoom_amplitude * 100));
@@ -361,17 +504,18 @@ void MainWindow::refreshCoreSettingsUi() {
 
     for (QWidget* w : m_controlsToManage) { w->blockSignals(false); }
     updateZoomControlVisibility();
+    updateFrameScrubberRange();
 }
 
 void MainWindow::on_zoomModeComboBox_currentIndexChanged(const QString& text) {
-    currentSettings.global_zoom_mode = text.toStdString();
+    parseEnum(text.toStdString(), currentSettings.global_zoom_mode);
     updateZoomControlVisibility();
     triggerPreviewUpdate();
 }
 
 void MainWindow::updateZoomControlVisibility() {
-    bool isLinear = (currentSettings.global_zoom_mode == "Linear");
-    bool isOscillating = (currentSettings.global_zoom_mode == "Oscillating");
+    bool isLinear = (currentSettings.global_zoom_mode == GlobalZoomMode::Linear);
+    bool isOscillating = (currentSettings.global_zoom_mode == GlobalZoomMode::Oscillating);
     linearZoomStrengthLabel->setVisible(isLinear);
     linearZoomStrengthSlider->setVisible(isLinear);
     linearZoomStrengthSpinBox->setVisible(isLinear);
@@ -400,10 +544,35 @@ void MainWindow::showStaticPreview() {
 }
 
 void MainWindow::triggerPreviewUpdate() {
-    previewUpdateTimer->start(200); 
+    previewUpdateTimer->start(PREVIEW_INTERACTIVE_DELAY_MS);
+    previewIdleTimer->start(PREVIEW_IDLE_DELAY_MS);
 }
 
 void MainWindow::generatePreviewFrame() {
+    updatePreview(previewGovernor.currentLevel());
+}
+
+void MainWindow::generateFullQualityPreview() {
+    updatePreview(0);
+}
+
+bool MainWindow::loadPreviewSource() {
+    if (previewSourcePath == currentSettings.image_path) return true;
+    if (preparingSourcePath == currentSettings.image_path) {
+        // Only waits for whatever is left of the background preparation.
+        adoptPreparedSource(sourcePreparation->future().result());
+        return previewSourcePath == currentSettings.image_path;
+    }
+
+    previewWorkingSource = loadSourceImage(currentSettings.image_path, GIF_WORKING_SIZE, cv::INTER_LANCZOS4);
+    if (previewWorkingSource.empty()) return false;
+    workingStageCache = std::make_shared<RenderStageCache>();
+    previewSourcePath = currentSettings.image_path;
+    previewSourceSize = 0;
+    return true;
+}
+
+void MainWindow::updatePreview(int quality_level) {
     if (!previewCheckBox->isChecked()) {
         showStaticPreview();
         return;
@@ -413,135 +582,74 @@ void MainWindow::generatePreviewFrame() {
         return;
     }
 
-    const int PREVIEW_SIZE = 250;
-    
-    cv::Mat original_image_bgr = cv::imread(currentSettings.image_path, cv::IMREAD_UNCHANGED);
-    if (original_image_bgr.empty()) {
+    if (preparingSourcePath == currentSettings.image_path) return; // handleSourcePrepared() takes over
+    if (!loadPreviewSource()) {
         previewRenderLabel->setText("Error: Could not load image file.");
         return;
     }
 
-    cv::Mat original_image_rgba;
-    if (original_image_bgr.channels() < 4) {
-         cv::cvtColor(original_image_bgr, original_image_rgba, cv::COLOR_BGR2BGRA);
-    } else {
-        original_image_rgba = original_image_bgr.clone();
+    // Frames are rendered at the size they are displayed at, so showing one
+    // never needs a rescale.
+    int render_size = previewRenderSize();
+    if (previewSourceSize != render_size) {
+        cv::Mat source;
+        cv::resize(previewWorkingSource, source, cv::Size(render_size, render_size), 0, 0, cv::INTER_AREA);
+        previewCache->setSource(source, previewRenderLabel->devicePixelRatioF());
+        previewSourceSize = render_size;
     }
-    cv::resize(original_image_rgba, original_image_rgba, cv::Size(PREVIEW_SIZE, PREVIEW_SIZE), 0, 0, cv::INTER_AREA);
 
-    int width = original_image_rgba.cols;
-    int height = original_image_rgba.rows;
-    
-    int i = currentSettings.num_frames / 2;
+    const PreviewQualityLevel& quality = PreviewQualityGovernor::level(quality_level);
+    FrameRenderOptions options;
+    options.warp_interpolation = quality.warp_interpolation;
+    options.layer_limit = quality.layer_limit;
+    options.min_layer_size = 1;
+    options.pixel_scale = static_cast<double>(render_size) / GIF_WORKING_SIZE;
+    previewCache->setSettings(currentSettings, options, quality.resolution_scale, quality_level);
+    previewQualityLevel = quality_level;
 
-    cv::Mat frame = cv::Mat::zeros(height, width, CV_8UC4);
-    double frame_progress = static_cast<double>(i) / currentSettings.num_frames;
-    
-    double num_rotations = std::round(currentSettings.rotation_speed / 2.0);
-    double total_rotation_degrees = num_rotations * 360.0;
-    if (currentSettings.rotation_direction == "Counter-Clockwise") total_rotation_degrees *= -1.0;
-    else if (currentSettings.rotation_direction == "None") total_rotation_degrees = 0.0;
-    double angle_per_frame = (currentSettings.num_frames > 0) ? (total_rotation_degrees / currentSettings.num_frames) : 0.0;
-
-    double effective_max_scale = 1.0;
-    double current_layer_scale = effective_max_scale;
-        
-    for (int layer = 0; layer < currentSettings.max_layers; ++layer) {
-        int scaled_width = static_cast<int>(width * current_layer_scale);
-        int scaled_height = static_cast<int>(height * current_layer_scale);
-        if (scaled_width < 1 || scaled_height < 1) break;
-        cv::Mat resized_image;
-        cv::resize(original_image_rgba, resized_image, cv::Size(scaled_width, scaled_height), 0, 0, cv::INTER_AREA);
-        double angle_degrees = angle_per_frame * i;
-        cv::Point2f center(scaled_width / 2.0F, scaled_height / 2.0F);
-        cv::Mat rot_mat = cv::getRotationMatrix2D(center, angle_degrees, 1.0);
-        cv::Mat rotated_image;
-        cv::warpAffine(resized_image, rotated_image, rot_mat, resized_image.size(), cv::INTER_LINEAR, cv::BORDER_CONSTANT, cv::Scalar(0,0,0,0));
-        int paste_x = (width/2) - (scaled_width/2);
-        int paste_y = (height/2) - (scaled_height/2);
-        cv::Rect roi(paste_x, paste_y, rotated_image.cols, rotated_image.rows);
-        cv::Rect frame_roi(0, 0, frame.cols, frame.rows);
-        cv::Rect intersection = roi & frame_roi;
-        if (intersection.empty()) continue;
-        cv::Mat frame_sub_view = frame(intersection);
-        cv::Mat rotated_sub_view = rotated_image(cv::Rect(intersection.x-roi.x, intersection.y-roi.y, intersection.width, intersection.height));
-        for (int r = 0; r < intersection.height; ++r) {
-            for (int c = 0; c < intersection.width; ++c) {
-                cv::Vec4b& frame_pixel = frame_sub_view.at<cv::Vec4b>(r, c);
-                cv::Vec4b& rotated_pixel = rotated_sub_view.at<cv::Vec4b>(r, c);
-                if (rotated_pixel[3] == 0) continue;
-                double alpha_rotated = rotated_pixel[3] / 255.0;
-                double alpha_frame = frame_pixel[3] / 255.0;
-                double new_alpha = alpha_rotated + alpha_frame * (1 - alpha_rotated);
-                if (new_alpha > 0) {
-                    for (int k = 0; k < 3; ++k) {
-                        frame_pixel[k] = static_cast<uchar>((rotated_pixel[k] * alpha_rotated + frame_pixel[k] * alpha_frame * (1 - alpha_rotated)) / new_alpha);
-                    }
-                    frame_pixel[3] = static_cast<uchar>(new_alpha * 255);
-                }
-            }
-        }
-        current_layer_scale *= currentSettings.scale_decay;
-    }
-    
-    // Apply Vignette effect for preview
-    if (currentSettings.vignette_strength > 0.0) {
-        cv::Mat vignette_mask(height, width, CV_32FC1);
-        cv::Point2f center(width / 2.0F, height / 2.0F);
-        double max_dist = std::sqrt(center.x * center.x + center.y * center.y);
-
-        for (int r = 0; r < height; ++r) {
-            for (int c = 0; c < width; ++c) {
-                double dist = cv::norm(cv::Point2f(c, r) - center);
-                double normalized_dist = dist / max_dist;
-                double vignette_value = 1.0 - currentSettings.vignette_strength * std::pow(normalized_dist, 2.0);
-                vignette_mask.at<float>(r, c) = static_cast<float>(std::max(0.0, std::min(1.0, vignette_value)));
-            }
-        }
+    showPreviewFrame(frameScrubber->value());
+}
 
-        for (int r = 0; r < height; ++r) {
-            for (int c = 0; c < width; ++c) {
-                cv::Vec4b& pixel = frame.at<cv::Vec4b>(r, c);
-                float mask_val = vignette_mask.at<float>(r, c);
-                for (int k = 0; k < 3; ++k) {
-                    pixel[k] = static_cast<uchar>(pixel[k] * mask_val);
-                }
-            }
-        }
-    }
+void MainWindow::scrubPreviewFrame(int frame_index) {
+    scrubDirection = (frame_index < lastScrubFrame) ? -1 : 1;
+    lastScrubFrame = frame_index;
+    frameScrubberLabel->setText(QString("%1 / %2").arg(frame_index + 1).arg(currentSettings.num_frames));
 
-    double global_scale = 1.0;
-    if (currentSettings.global_zoom_mode == "Linear") {
-        global_scale = 1.0 + (currentSettings.linear_zoom_speed * frame_progress);
-    } else if (currentSettings.global_zoom_mode == "Oscillating") {
-        double sine_wave = sin(frame_progress * 2.0 * M_PI * currentSettings.oscillating_zoom_frequency);
-        double zoom_center = currentSettings.oscillating_zoom_midpoint;
-        global_scale = zoom_center + (currentSettings.oscillating_zoom_amplitude * sine_wave);
-    }
+    // A pending settings change will render this frame once the interactive timer fires.
+    if (previewUpdateTimer->isActive() || !previewCheckBox->isChecked() || !previewCache->hasSource()) return;
+    showPreviewFrame(frame_index);
+}
 
-    if (global_scale != 1.0) {
-        cv::Mat zoom_matrix = cv::getRotationMatrix2D(cv::Point2f(width / 2.0f, height / 2.0f), 0.0, global_scale);
-        cv::warpAffine(frame, frame, zoom_matrix, frame.size(), cv::INTER_LINEAR, cv::BORDER_REFLECT_101);
-    }
+void MainWindow::showPreviewFrame(int frame_index) {
+    QImage preview_qimage = previewCache->frame(frame_index);
+    previewCache->prefetch(frame_index, scrubDirection);
+    if (preview_qimage.isNull()) return; // Shown by handlePreviewFrameReady() once rendered
 
-    if (currentSettings.hue_speed > 0 && currentSettings.hue_intensity > 0) {
-        cv::Mat hsv_frame, temp_bgr;
-        cv::cvtColor(frame, temp_bgr, cv::COLOR_BGRA2BGR);
-        cv::cvtColor(temp_bgr, hsv_frame, cv::COLOR_BGR2HSV);
-        double saturation_pulse = sin(frame_progress * 2.0 * M_PI * (currentSettings.hue_speed / 4.0));
-        double saturation_multiplier = 1.0 + (saturation_pulse * (currentSettings.hue_intensity - 1.0));
-        for (int r = 0; r < hsv_frame.rows; ++r) {
-            for (int c = 0; c < hsv_frame.cols; ++c) {
-                auto& pixel = hsv_frame.at<cv::Vec3b>(r, c);
-                pixel[0] = static_cast<uchar>(std::fmod((pixel[0] + (i * currentSettings.hue_speed)), 180.0));
-                pixel[1] = cv::saturate_cast<uchar>(pixel[1] * saturation_multiplier);
-            }
-        }
-        cv::cvtColor(hsv_frame, temp_bgr, cv::COLOR_HSV2BGR);
-        cv::cvtColor(temp_bgr, frame, cv::COLOR_BGR2BGRA);
-    }
-    
-    cv::cvtColor(frame, frame, cv::COLOR_BGRA2RGBA);
-    QImage preview_qimage(frame.data, frame.cols, frame.rows, frame.step, QImage::Format_RGBA8888);
-    previewRenderLabel->setPixmap(QPixmap::fromImage(preview_qimage.copy()).scaled(previewRenderLabel->size(), Qt::KeepAspectRatio, Qt::SmoothTransformation));
-}
\ No newline at end of file
+    previewRenderLabel->setPixmap(QPixmap::fromImage(std::move(preview_qimage)));
+    previewQualityLabel->setVisible(previewQualityLevel > 0);
+}
+
+void MainWindow::handlePreviewFrameReady(int frame_index, int quality_level, qint64 render_nsecs) {
+    previewGovernor.recordRenderTime(quality_level, render_nsecs);
+    if (frame_index != frameScrubber->value() || !previewCheckBox->isChecked()) return;
+    showPreviewFrame(frame_index);
+}
+
+int MainWindow::previewRenderSize() const {
+    QSize area = previewRenderLabel->contentsRect().size() * previewRenderLabel->devicePixelRatioF();
+    return std::max(16, std::min(area.width(), area.height()));
+}
+
+void MainWindow::resizeEvent(QResizeEvent* event) {
+    QMainWindow::resizeEvent(event);
+    triggerPreviewUpdate();
+}
+
+void MainWindow::updateFrameScrubberRange() {
+    frameScrubber->blockSignals(true);
+    frameScrubber->setRange(0, std::max(0, currentSettings.num_frames - 1));
+    frameScrubber->blockSignals(false);
+
+    lastScrubFrame = frameScrubber->value();
+    frameScrubberLabel->setText(QString("%1 / %2").arg(frameScrubber->value() + 1).arg(currentSettings.num_frames));
+}
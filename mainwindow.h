@@ -19,11 +19,20 @@
 #include <QList>
 #include <QCheckBox>
 #include <QTimer>
+#include <QResizeEvent>
+#include <QFutureWatcher>
+#include <memory>
+#include <opencv2/opencv.hpp>
 
 #include "gif_settings.h"
+#include "frame_renderer.h"
+#include "preview_quality_governor.h"
 
 class GifWorker;
 class AdvancedSettingsDialog;
+class PreviewFrameCache;
+class RenderProgress;
+class RenderCache;
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
@@ -32,25 +41,39 @@ public:
     explicit MainWindow(QWidget *parent = nullptr);
     ~MainWindow() override;
 
+protected:
+    void resizeEvent(QResizeEvent* event) override;
+
 private slots:
     void browseImage();
     void openAdvancedSettings();
+    void openChaosExplorer();
     void startGifGeneration();
-    void handleGenerationProgress(int percentage, const QString& message);
+    void updateGenerationProgress();
     void handleGenerationFinished(bool success, const QString& pathOrMessage);
     void refreshCoreSettingsUi();
     void on_zoomModeComboBox_currentIndexChanged(const QString& text);
     void triggerPreviewUpdate(); // New slot to trigger preview updates
     void generatePreviewFrame(); // New slot to perform the preview render
+    void generateFullQualityPreview();
+    void scrubPreviewFrame(int frame_index);
+    void handlePreviewFrameReady(int frame_index, int quality_level, qint64 render_nsecs);
+    void handleSourcePrepared();
 
 private:
     GifSettings currentSettings;
     GifWorker* worker = nullptr;
     QThread* workerThread = nullptr;
+    std::shared_ptr<const RenderProgress> generationProgress; // Sampled by generationProgressTimer
+    QTimer* generationProgressTimer;
+    std::shared_ptr<RenderCache> renderCache; // Re-saving an unchanged GIF copies it from here
 
     // --- GUI Widgets ---
     QCheckBox* previewCheckBox; // New checkbox to enable/disable preview
     QLabel* previewRenderLabel; // Replaces the old static image label
+    QLabel* previewQualityLabel; // Shown while the preview is rendered at reduced quality
+    QSlider* frameScrubber;
+    QLabel* frameScrubberLabel;
     QLineEdit* imagePathEdit;
     QPushButton* browseButton;
     
@@ -58,6 +81,7 @@ private:
     QSpinBox* numFramesSpinBox;
     QSlider* scaleDecaySlider;
     QDoubleSpinBox* scaleDecaySpinBox;
+    QComboBox* tunnelModeCombo;
     QSlider* rotationSpeedSlider;
     QDoubleSpinBox* rotationSpeedSpinBox;
     QSlider* hueSpeedSlider;
@@ -67,6 +91,7 @@ private:
     
     QComboBox* rotationDirectionCombo;
     QPushButton* advancedButton;
+    QPushButton* chaosExplorerButton;
     QPushButton* generateButton;
     QPushButton* cancelButton;
     QProgressBar* progressBar;
@@ -91,11 +116,30 @@ private:
 
     QList<QWidget*> m_controlsToManage;
     QTimer* previewUpdateTimer; // New timer for debouncing UI updates
+    QTimer* previewIdleTimer; // Fires once the controls settle, for a full-quality render
+    PreviewQualityGovernor previewGovernor;
+    int previewQualityLevel = 0; // Quality level previewCache is currently rendering at
+    PreviewFrameCache* previewCache;
+    QFutureWatcher<PreparedSource>* sourcePreparation; // Decodes a newly picked image in the background
+    std::string preparingSourcePath; // Image sourcePreparation is working on, empty once adopted
+    std::string previewSourcePath; // Image previewWorkingSource was loaded from
+    cv::Mat previewWorkingSource; // Source at GIF resolution, scaled down to the preview size on demand
+    std::shared_ptr<RenderStageCache> workingStageCache; // Stages of previewWorkingSource, kept for every GIF rendered from it
+    int previewSourceSize = 0; // Size of the source currently loaded into previewCache
+    int lastScrubFrame = 0;
+    int scrubDirection = 1;
 
     void setupUi();
     void setupConnections();
     void updateZoomControlVisibility();
     void showStaticPreview(); // New helper to show the original image
+    void startSourcePreparation();
+    void adoptPreparedSource(const PreparedSource& prepared);
+    bool loadPreviewSource();
+    void updatePreview(int quality_level);
+    void showPreviewFrame(int frame_index);
+    void updateFrameScrubberRange();
+    int previewRenderSize() const;
 };
 
 #endif // MAINWINDOW_H
\ No newline at end of file
@@ -0,0 +1,157 @@
+// mat_pool.cpp
+#include "mat_pool.h"
+#include "stage_timer.h"
+#include <atomic>
+#include <vector>
+
+namespace {
+
+// Size classes step through 2^k, 1.25 * 2^k, 1.5 * 2^k and 1.75 * 2^k, so
+// a pooled buffer is never more than a quarter larger than requested.
+const int MIN_CLASS_SHIFT = 6; // 64 bytes
+const int MAX_CLASS_SHIFT = 27; // Buffers over 128 MB are not pooled
+const int NUM_SIZE_CLASSES = (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT) * 4 + 1;
+const std::size_t MAX_POOLED_BYTES = std::size_t(1) << MAX_CLASS_SHIFT;
+// Bytes held by the pools of all threads; frees beyond
+// MAT_POOL_MAX_CACHED_BYTES go back to the heap.
+std::atomic<std::size_t> g_cached_bytes{0};
+
+int sizeClass(std::size_t bytes, std::size_t* class_bytes) {
+    std::size_t min_bytes = std::size_t(1) << MIN_CLASS_SHIFT;
+    if (bytes <= min_bytes) {
+        *class_bytes = min_bytes;
+        return 0;
+    }
+    int shift = MIN_CLASS_SHIFT;
+    while ((std::size_t(2) << shift) <= bytes - 1) ++shift;
+    std::size_t base = std::size_t(1) << shift;
+    std::size_t quarter = base / 4;
+    std::size_t quarters = (bytes - base + quarter - 1) / quarter; // 1 to 4
+    *class_bytes = base + quarters * quarter;
+    return (shift - MIN_CLASS_SHIFT) * 4 + static_cast<int>(quarters);
+}
+
+thread_local bool t_cache_destroyed = false;
+
+struct ThreadCache {
+    std::vector<void*> free_blocks[NUM_SIZE_CLASSES];
+    std::size_t cached_bytes = 0;
+
+    void clear() {
+        for (std::vector<void*>& blocks : free_blocks) {
+            for (void* block : blocks) cv::fastFree(block);
+            blocks.clear();
+        }
+        g_cached_bytes -= cached_bytes;
+        cached_bytes = 0;
+    }
+
+    ~ThreadCache() {
+        clear();
+        t_cache_destroyed = true;
+    }
+};
+
+// Null once the thread is exiting, after which buffers bypass the pool.
+ThreadCache* threadCache() {
+    if (t_cache_destroyed) return nullptr;
+    thread_local ThreadCache cache;
+    return &cache;
+}
+
+AllocationStats* currentAllocationStats() {
+    StageProfile* profile = currentStageProfile();
+    return profile ? &profile->allocations() : nullptr;
+}
+
+uchar* acquireBuffer(std::size_t bytes) {
+    bool from_heap = true;
+    void* block = nullptr;
+    if (bytes <= MAX_POOLED_BYTES) {
+        std::size_t class_bytes = 0;
+        int size_class = sizeClass(bytes, &class_bytes);
+        ThreadCache* cache = threadCache();
+        if (cache && !cache->free_blocks[size_class].empty()) {
+            block = cache->free_blocks[size_class].back();
+            cache->free_blocks[size_class].pop_back();
+            cache->cached_bytes -= class_bytes;
+            g_cached_bytes -= class_bytes;
+            from_heap = false;
+        } else {
+            block = cv::fastMalloc(class_bytes);
+        }
+    } else {
+        block = cv::fastMalloc(bytes);
+    }
+    if (AllocationStats* stats = currentAllocationStats()) stats->recordAllocation(bytes, from_heap);
+    return static_cast<uchar*>(block);
+}
+
+void releaseBuffer(void* block, std::size_t bytes) {
+    if (AllocationStats* stats = currentAllocationStats()) stats->recordRelease(bytes);
+    if (bytes <= MAX_POOLED_BYTES) {
+        std::size_t class_bytes = 0;
+        int size_class = sizeClass(bytes, &class_bytes);
+        ThreadCache* cache = threadCache();
+        if (cache && g_cached_bytes.fetch_add(class_bytes) + class_bytes <= MAT_POOL_MAX_CACHED_BYTES) {
+            cache->free_blocks[size_class].push_back(block);
+            cache->cached_bytes += class_bytes;
+            return;
+        }
+        if (cache) g_cached_bytes -= class_bytes;
+    }
+    cv::fastFree(block);
+}
+
+} // namespace
+
+// Lays out the buffer exactly as OpenCV's standard allocator does; only
+// where the memory comes from differs.
+cv::UMatData* PooledMatAllocator::allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                                           cv::AccessFlag, cv::UMatUsageFlags) const {
+    std::size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; --i) {
+        if (step) {
+            if (data && step[i] != CV_AUTOSTEP) {
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    cv::UMatData* u = new cv::UMatData(this);
+    u->data = u->origdata = data ? static_cast<uchar*>(data) : acquireBuffer(total);
+    u->size = total;
+    if (data) u->flags |= cv::UMatData::USER_ALLOCATED;
+    return u;
+}
+
+bool PooledMatAllocator::allocate(cv::UMatData* data, cv::AccessFlag, cv::UMatUsageFlags) const {
+    return data != nullptr;
+}
+
+void PooledMatAllocator::deallocate(cv::UMatData* data) const {
+    if (!data) return;
+    CV_Assert(data->urefcount == 0);
+    CV_Assert(data->refcount == 0);
+    if (!(data->flags & cv::UMatData::USER_ALLOCATED)) {
+        releaseBuffer(data->origdata, data->size);
+        data->origdata = nullptr;
+    }
+    delete data;
+}
+
+PooledMatAllocator* pooledMatAllocator() {
+    static PooledMatAllocator* allocator = new PooledMatAllocator();
+    return allocator;
+}
+
+void installPooledMatAllocator() {
+    cv::Mat::setDefaultAllocator(pooledMatAllocator());
+}
+
+void trimThreadMatPool() {
+    if (ThreadCache* cache = threadCache()) cache->clear();
+}
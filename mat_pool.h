@@ -0,0 +1,39 @@
+// mat_pool.h
+#ifndef MAT_POOL_H
+#define MAT_POOL_H
+
+#include <opencv2/opencv.hpp>
+
+// Most memory the pools of all threads together keep for reuse.
+const std::size_t MAT_POOL_MAX_CACHED_BYTES = std::size_t(256) << 20;
+
+// A cv::MatAllocator that keeps freed buffers in per-thread pools, one free
+// list per size class, and hands them out again instead of going back to
+// the heap. The pools share one MAT_POOL_MAX_CACHED_BYTES budget, so the
+// memory they retain does not grow with the number of threads. Rendering a frame allocates the same scratch buffers every
+// time, so once the first frames have filled the pools the rest allocate
+// nothing. Allocations are counted in the AllocationStats of the calling
+// thread's StageProfile; a buffer freed on another job's thread is counted
+// against that job.
+class PooledMatAllocator : public cv::MatAllocator {
+public:
+    cv::UMatData* allocate(int dims, const int* sizes, int type, void* data, size_t* step,
+                           cv::AccessFlag flags, cv::UMatUsageFlags usage_flags) const override;
+    bool allocate(cv::UMatData* data, cv::AccessFlag access_flags, cv::UMatUsageFlags usage_flags) const override;
+    void deallocate(cv::UMatData* data) const override;
+};
+
+// The process-wide pooled allocator. It is never destroyed, since Mats may
+// outlive any owner.
+PooledMatAllocator* pooledMatAllocator();
+
+// Makes pooledMatAllocator() OpenCV's default allocator. Call once at
+// startup, before rendering.
+void installPooledMatAllocator();
+
+// Frees the buffers the calling thread's pool holds, e.g. when a batch job
+// finishes, so a pool thread does not keep them for a job that may never
+// come.
+void trimThreadMatPool();
+
+#endif // MAT_POOL_H
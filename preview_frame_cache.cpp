@@ -0,0 +1,204 @@
+// preview_frame_cache.cpp
+#include "preview_frame_cache.h"
+#include <QMetaObject>
+#include <QElapsedTimer>
+#include <QRunnable>
+#include <QSysInfo>
+#include <algorithm>
+#include <functional>
+#include <mutex>
+
+namespace {
+
+// Lets preview renders be queued on the pool with a priority, so the frame
+// on screen overtakes queued prefetches.
+class FrameRenderTask : public QRunnable {
+public:
+    explicit FrameRenderTask(std::function<void()> work) : m_work(std::move(work)) {}
+    void run() override { m_work(); }
+
+private:
+    std::function<void()> m_work;
+};
+
+} // namespace
+
+// Scaling the source and constructing the renderer both walk the whole
+// image, so they run on the render pool rather than on every settings change.
+struct PreviewFrameCache::LazyRenderer {
+    std::function<std::shared_ptr<const FrameRenderer>()> build;
+    std::once_flag built;
+    std::shared_ptr<const FrameRenderer> renderer;
+
+    const FrameRenderer& get() {
+        std::call_once(built, [this]() {
+            renderer = build();
+            build = nullptr;
+        });
+        return *renderer;
+    }
+};
+
+bool operator==(const PreviewFrameKey& a, const PreviewFrameKey& b) {
+    return a.settings_hash == b.settings_hash && a.frame_index == b.frame_index;
+}
+
+uint qHash(const PreviewFrameKey& key, uint seed) {
+    return qHash(key.settings_hash, seed) ^ qHash(key.frame_index, seed);
+}
+
+PreviewFrameCache::PreviewFrameCache(int budget_bytes, QObject* parent)
+    : QObject(parent), m_frames(budget_bytes) {
+    m_pool.setMaxThreadCount(2);
+}
+
+PreviewFrameCache::~PreviewFrameCache() {
+    // Render tasks post their results back to this object, so they must
+    // be finished before it goes away.
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+void PreviewFrameCache::setSource(const cv::Mat& source_bgra, qreal device_pixel_ratio) {
+    m_pool.clear();
+    m_pending.clear();
+    m_frames.clear();
+    ++m_generation;
+    m_source = source_bgra;
+    m_device_pixel_ratio = device_pixel_ratio;
+    m_stage_cache = std::make_shared<RenderStageCache>();
+    rebuildRenderer();
+}
+
+void PreviewFrameCache::setSettings(const GifSettings& settings, const FrameRenderOptions& options,
+                                    double resolution_scale, int quality_level) {
+    quint64 settings_hash = renderHash(settings, options, resolution_scale);
+    m_quality_level = quality_level;
+    if (m_renderer && settings_hash == m_settings_hash) return;
+
+    // Queued renders are for the old settings; frames that already made it
+    // into the cache stay there in case the user steps back.
+    m_pool.clear();
+    m_pending.clear();
+    m_settings = settings;
+    m_options = options;
+    m_resolution_scale = resolution_scale;
+    m_settings_hash = settings_hash;
+    rebuildRenderer();
+}
+
+void PreviewFrameCache::rebuildRenderer() {
+    if (m_source.empty()) {
+        m_renderer.reset();
+        return;
+    }
+
+    cv::Mat source = m_source;
+    GifSettings settings = m_settings;
+    FrameRenderOptions options = m_options;
+    std::shared_ptr<RenderStageCache> stage_cache = m_stage_cache;
+    m_renderer = std::make_shared<LazyRenderer>();
+    if (m_resolution_scale >= 1.0) {
+        m_render_width = source.cols;
+        m_renderer->build = [source, settings, options, stage_cache]() {
+            return std::make_shared<const FrameRenderer>(source, settings, options, stage_cache);
+        };
+        return;
+    }
+
+    cv::Size scaled_size(std::max(1, static_cast<int>(source.cols * m_resolution_scale)),
+                         std::max(1, static_cast<int>(source.rows * m_resolution_scale)));
+    m_render_width = scaled_size.width;
+    options.pixel_scale *= static_cast<double>(scaled_size.width) / source.cols;
+    m_renderer->build = [source, scaled_size, settings, options, stage_cache]() {
+        cv::Mat scaled_source;
+        cv::resize(source, scaled_source, scaled_size, 0, 0, cv::INTER_AREA);
+        return std::make_shared<const FrameRenderer>(scaled_source, settings, options, stage_cache);
+    };
+}
+
+QImage PreviewFrameCache::frame(int frame_index) {
+    if (!m_renderer) return QImage();
+
+    PreviewFrameKey key{m_settings_hash, frame_index};
+    if (QImage* cached = m_frames.object(key)) {
+        return *cached;
+    }
+    if (!m_pending.contains(key)) {
+        scheduleRender(key, VISIBLE_FRAME_PRIORITY);
+    }
+    return QImage();
+}
+
+void PreviewFrameCache::prefetch(int frame_index, int direction) {
+    int num_frames = m_settings.num_frames;
+    if (!m_renderer || num_frames <= 0) return;
+
+    for (int step = 1; step <= PREFETCH_AHEAD && step < num_frames; ++step) {
+        int target = ((frame_index + direction * step) % num_frames + num_frames) % num_frames;
+        PreviewFrameKey key{m_settings_hash, target};
+        if (m_frames.contains(key) || m_pending.contains(key)) continue;
+        scheduleRender(key, PREFETCH_PRIORITY);
+    }
+}
+
+void PreviewFrameCache::scheduleRender(const PreviewFrameKey& key, int priority) {
+    m_pending.insert(key);
+    std::shared_ptr<LazyRenderer> renderer = m_renderer;
+    quint64 generation = m_generation;
+    int quality_level = m_quality_level;
+    // A frame rendered below the display size gets a proportionally lower
+    // pixel ratio, so QLabel still draws it at the full logical size.
+    qreal device_pixel_ratio = m_device_pixel_ratio * m_render_width / m_source.cols;
+    m_pool.start(new FrameRenderTask([this, renderer, generation, key, quality_level, device_pixel_ratio]() {
+        QElapsedTimer timer;
+        timer.start();
+        QImage image = renderImage(renderer->get(), key.frame_index, device_pixel_ratio);
+        qint64 render_nsecs = timer.nsecsElapsed();
+        QMetaObject::invokeMethod(this, [this, generation, key, image, quality_level, render_nsecs]() {
+            storeFrame(generation, key, image, quality_level, render_nsecs);
+        }, Qt::QueuedConnection);
+    }), priority);
+}
+
+void PreviewFrameCache::storeFrame(quint64 generation, const PreviewFrameKey& key, const QImage& image, int quality_level,
+                                   qint64 render_nsecs) {
+    m_pending.remove(key);
+    if (generation != m_generation || image.isNull()) return;
+    if (!m_frames.contains(key)) {
+        m_frames.insert(key, new QImage(image), static_cast<int>(image.sizeInBytes()));
+    }
+    // A render for superseded settings says nothing about the current
+    // quality level, so only current frames are reported.
+    if (key.settings_hash == m_settings_hash) {
+        emit frameReady(key.frame_index, quality_level, render_nsecs);
+    }
+}
+
+quint64 PreviewFrameCache::renderHash(const GifSettings& settings, const FrameRenderOptions& options,
+                                      double resolution_scale) {
+    std::size_t combined = settings.hash();
+    auto combine = [&combined](std::size_t value) {
+        combined ^= value + 0x9e3779b9 + (combined << 6) + (combined >> 2);
+    };
+    combine(std::hash<int>()(options.warp_interpolation));
+    combine(std::hash<int>()(options.min_layer_size));
+    combine(std::hash<int>()(options.layer_limit));
+    combine(std::hash<double>()(options.pixel_scale));
+    combine(std::hash<double>()(resolution_scale));
+    return combined;
+}
+
+QImage PreviewFrameCache::renderImage(const FrameRenderer& renderer, int frame_index, qreal device_pixel_ratio) {
+    // Render straight into the QImage's pixels: RGB32 is B,G,R,0xFF in memory
+    // on little-endian hosts, so no channel swap, copy or rescale is needed
+    // before display, and QPixmap::fromImage() can adopt the buffer as is.
+    bool little_endian = (QSysInfo::ByteOrder == QSysInfo::LittleEndian);
+    QImage image(renderer.width(), renderer.height(), little_endian ? QImage::Format_RGB32 : QImage::Format_RGBX8888);
+    if (image.isNull()) return image;
+    image.setDevicePixelRatio(device_pixel_ratio);
+
+    cv::Mat target(image.height(), image.width(), CV_8UC4, image.bits(), static_cast<size_t>(image.bytesPerLine()));
+    renderer.renderFrame(frame_index, target, little_endian ? FrameOutputFormat::OpaqueBGRA : FrameOutputFormat::OpaqueRGBA);
+    return image;
+}
@@ -0,0 +1,93 @@
+// preview_frame_cache.h
+#ifndef PREVIEW_FRAME_CACHE_H
+#define PREVIEW_FRAME_CACHE_H
+
+#include <QObject>
+#include <QCache>
+#include <QImage>
+#include <QSet>
+#include <QThreadPool>
+#include <memory>
+#include <opencv2/opencv.hpp>
+#include "gif_settings.h"
+#include "frame_renderer.h"
+
+// Identifies a rendered preview frame: the settings it was rendered with and
+// its position in the animation.
+struct PreviewFrameKey {
+    quint64 settings_hash;
+    int frame_index;
+};
+
+bool operator==(const PreviewFrameKey& a, const PreviewFrameKey& b);
+uint qHash(const PreviewFrameKey& key, uint seed = 0);
+
+// LRU cache of rendered preview frames, bounded by a memory budget. Every
+// frame is rendered on a background pool directly into the QImage that gets
+// displayed, and frames ahead of the one on screen are rendered early so that
+// scrubbing through the timeline is instant after the first pass.
+class PreviewFrameCache : public QObject {
+    Q_OBJECT
+
+public:
+    explicit PreviewFrameCache(int budget_bytes, QObject* parent = nullptr);
+    ~PreviewFrameCache() override;
+
+    // Replaces the prepared BGRA source and drops every cached frame. The
+    // source should already be the size the frames are displayed at.
+    void setSource(const cv::Mat& source_bgra, qreal device_pixel_ratio = 1.0);
+    // `resolution_scale` < 1 renders below the display size; the frames carry
+    // a matching device pixel ratio so they are still shown at full size.
+    // `quality_level` is reported back by frameReady() for frames rendered
+    // with these settings.
+    void setSettings(const GifSettings& settings, const FrameRenderOptions& options,
+                     double resolution_scale = 1.0, int quality_level = 0);
+    bool hasSource() const { return !m_source.empty(); }
+
+    // Returns the requested frame if it is cached. Otherwise returns a null
+    // image and renders the frame in the background; frameReady() is
+    // emitted once it is available, with the quality level it was rendered
+    // at and the time the render took. Frames for superseded settings are
+    // cached silently.
+    QImage frame(int frame_index);
+    // Queues background renders of the frames after `frame_index` in the
+    // given direction (+1 or -1), wrapping around like the GIF loop does.
+    void prefetch(int frame_index, int direction);
+
+    // Renders one frame straight into an opaque QImage that can be displayed
+    // without conversion. Safe to call from any thread.
+    static QImage renderImage(const FrameRenderer& renderer, int frame_index, qreal device_pixel_ratio);
+
+signals:
+    void frameReady(int frame_index, int quality_level, qint64 render_nsecs);
+
+private:
+    static const int PREFETCH_AHEAD = 8;
+    static const int VISIBLE_FRAME_PRIORITY = 1;
+    static const int PREFETCH_PRIORITY = 0;
+
+    QCache<PreviewFrameKey, QImage> m_frames;
+    QSet<PreviewFrameKey> m_pending;
+    QThreadPool m_pool;
+
+    cv::Mat m_source;
+    qreal m_device_pixel_ratio = 1.0;
+    GifSettings m_settings;
+    FrameRenderOptions m_options;
+    double m_resolution_scale = 1.0;
+    int m_quality_level = 0;
+    int m_render_width = 0;
+    struct LazyRenderer;
+    std::shared_ptr<LazyRenderer> m_renderer; // Built by the first render task that needs it
+    std::shared_ptr<RenderStageCache> m_stage_cache; // Shared by every renderer of m_source
+    quint64 m_settings_hash = 0;
+    quint64 m_generation = 0; // Bumped on every source change so stale prefetches are dropped
+
+    void rebuildRenderer();
+    void scheduleRender(const PreviewFrameKey& key, int priority);
+    void storeFrame(quint64 generation, const PreviewFrameKey& key, const QImage& image, int quality_level,
+                    qint64 render_nsecs);
+    static quint64 renderHash(const GifSettings& settings, const FrameRenderOptions& options, double resolution_scale);
+};
+
+#endif // PREVIEW_FRAME_CACHE_H
@@ -0,0 +1,54 @@
+// preview_quality_governor.cpp
+#include "preview_quality_governor.h"
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+
+namespace {
+
+const PreviewQualityLevel QUALITY_LEVELS[] = {
+    {1.00, 0, cv::INTER_LINEAR},
+    {0.75, 0, cv::INTER_LINEAR},
+    {0.50, 8, cv::INTER_LINEAR},
+    {0.35, 5, cv::INTER_NEAREST},
+    {0.25, 3, cv::INTER_NEAREST},
+};
+
+// Only step back up when the better level is predicted to fit with room to
+// spare, so the preview doesn't flip between two levels.
+const double UPGRADE_HEADROOM = 0.7;
+
+} // namespace
+
+PreviewQualityGovernor::PreviewQualityGovernor(double budget_ms)
+    : m_budget_ms(budget_ms) {}
+
+int PreviewQualityGovernor::levelCount() {
+    return static_cast<int>(sizeof(QUALITY_LEVELS) / sizeof(QUALITY_LEVELS[0]));
+}
+
+const PreviewQualityLevel& PreviewQualityGovernor::level(int index) {
+    return QUALITY_LEVELS[std::max(0, std::min(levelCount() - 1, index))];
+}
+
+double PreviewQualityGovernor::relativeCost(int level_index) {
+    // Every stage scales with the pixel count; layer caps and cheaper
+    // interpolation are extra savings the estimate leaves as headroom.
+    double scale = level(level_index).resolution_scale;
+    return scale * scale;
+}
+
+void PreviewQualityGovernor::recordRenderTime(int level_index, std::int64_t nsecs) {
+    double measured_ms = nsecs / 1e6;
+    double full_quality_ms = measured_ms / relativeCost(level_index);
+
+    if (measured_ms > m_budget_ms) {
+        // Too slow: jump straight to the best level predicted to fit.
+        int next = level_index;
+        while (next < levelCount() - 1 && full_quality_ms * relativeCost(next) > m_budget_ms) {
+            ++next;
+        }
+        m_level = std::max(m_level, next);
+    } else if (m_level > 0 && full_quality_ms * relativeCost(m_level - 1) < m_budget_ms * UPGRADE_HEADROOM) {
+        --m_level;
+    }
+}
@@ -0,0 +1,38 @@
+// preview_quality_governor.h
+#ifndef PREVIEW_QUALITY_GOVERNOR_H
+#define PREVIEW_QUALITY_GOVERNOR_H
+
+#include <cstdint>
+
+// One step on the preview quality ladder. Level 0 is full quality.
+struct PreviewQualityLevel {
+    double resolution_scale; // Fraction of the display size the frame is rendered at
+    int layer_limit;         // Caps max_layers when > 0
+    int warp_interpolation;
+};
+
+// Picks the preview quality level for interactive updates from measured
+// render times, so that dragging a control keeps the preview within a
+// frame-time budget however expensive the settings are.
+class PreviewQualityGovernor {
+public:
+    explicit PreviewQualityGovernor(double budget_ms = 16.0);
+
+    static int levelCount();
+    static const PreviewQualityLevel& level(int index);
+
+    // Level interactive renders should use next.
+    int currentLevel() const { return m_level; }
+
+    // Feeds back how long a frame rendered at `level_index` took.
+    void recordRenderTime(int level_index, std::int64_t nsecs);
+
+private:
+    double m_budget_ms;
+    int m_level = 0;
+
+    // Relative cost of rendering at `level_index` compared to full quality.
+    static double relativeCost(int level_index);
+};
+
+#endif // PREVIEW_QUALITY_GOVERNOR_H
@@ -0,0 +1,125 @@
+// render_cache.cpp
+#include "render_cache.h"
+#include "frame_renderer.h"
+#include "gif_settings_json.h"
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+bool writeAtomically(const QString& path, const QByteArray& data) {
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) return false;
+    if (file.write(data) != data.size()) {
+        file.cancelWriting();
+        return false;
+    }
+    return file.commit();
+}
+
+} // namespace
+
+RenderCache::RenderCache(const QString& directory, qint64 max_bytes)
+    : m_directory(directory), m_max_bytes(max_bytes) {
+    QDir().mkpath(m_directory);
+}
+
+QString RenderCache::defaultDirectory() {
+    return QDir(QStandardPaths::writableLocation(QStandardPaths::CacheLocation)).filePath("renders");
+}
+
+QByteArray RenderCache::sourceDigest(const std::string& image_path) {
+    QFile source(QString::fromStdString(image_path));
+    if (image_path.empty() || !source.open(QIODevice::ReadOnly)) return QByteArray();
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    if (!hash.addData(&source)) return QByteArray();
+    return hash.result();
+}
+
+QString RenderCache::key(const QByteArray& source_digest, const GifSettings& settings) {
+    if (source_digest.isEmpty() || settings.seed == 0) return QString();
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(QByteArray::number(RENDERER_VERSION));
+    hash.addData(source_digest);
+
+    // QJsonObject keeps its keys sorted, so equal settings serialize equally.
+    QJsonObject canonical = settingsToJson(settings);
+    canonical.remove("image_path");
+    hash.addData(QJsonDocument(canonical).toJson(QJsonDocument::Compact));
+    return QString::fromLatin1(hash.result().toHex());
+}
+
+QString RenderCache::gifPath(const QString& key) const {
+    return QDir(m_directory).filePath(key + ".gif");
+}
+
+QString RenderCache::infoPath(const QString& key) const {
+    return QDir(m_directory).filePath(key + ".json");
+}
+
+bool RenderCache::contains(const QString& key) const {
+    return !key.isEmpty() && QFileInfo::exists(gifPath(key));
+}
+
+bool RenderCache::fetch(const QString& key, const QString& output_path, CachedRender* info) {
+    if (key.isEmpty()) return false;
+
+    // The info file is written before the GIF, so it exists whenever the GIF does.
+    QFile info_file(infoPath(key));
+    QFile gif_file(gifPath(key));
+    if (!gif_file.open(QIODevice::ReadOnly) || !info_file.open(QIODevice::ReadOnly)) return false;
+    QJsonObject json = QJsonDocument::fromJson(info_file.readAll()).object();
+    QByteArray gif = gif_file.readAll();
+    if (gif.isEmpty() || !writeAtomically(output_path, gif)) return false;
+
+    if (info) {
+        info->seed = json.value("seed").toInt();
+        info->frame_checksums.clear();
+        for (const QJsonValue& checksum : json.value("frame_checksums").toArray()) {
+            info->frame_checksums.push_back(checksum.toString().toULongLong(nullptr, 16));
+        }
+    }
+    // Eviction goes by modification time, so a hit marks the entry as recently used.
+    gif_file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+    return true;
+}
+
+bool RenderCache::store(const QString& key, const QString& gif_path, const CachedRender& info) {
+    if (key.isEmpty()) return false;
+    QFile gif_file(gif_path);
+    if (!gif_file.open(QIODevice::ReadOnly)) return false;
+
+    QJsonArray checksums;
+    for (std::uint64_t checksum : info.frame_checksums) {
+        checksums.append(QString("%1").arg(static_cast<qulonglong>(checksum), 16, 16, QChar('0')));
+    }
+    QJsonObject json{{"seed", info.seed}, {"frame_checksums", checksums}};
+    if (!writeAtomically(infoPath(key), QJsonDocument(json).toJson(QJsonDocument::Compact)) ||
+        !writeAtomically(gifPath(key), gif_file.readAll())) {
+        return false;
+    }
+    evict();
+    return true;
+}
+
+void RenderCache::evict() const {
+    QDir dir(m_directory);
+    QFileInfoList entries = dir.entryInfoList(QStringList{"*.gif"}, QDir::Files, QDir::Time); // Newest first
+    qint64 total_bytes = 0;
+    for (const QFileInfo& entry : entries) {
+        total_bytes += entry.size();
+        if (total_bytes <= m_max_bytes) continue;
+        QFile::remove(entry.absoluteFilePath());
+        QFile::remove(dir.filePath(entry.completeBaseName() + ".json"));
+    }
+}
@@ -0,0 +1,63 @@
+// render_cache.h
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include <QByteArray>
+#include <QString>
+#include <QtGlobal>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gif_settings.h"
+
+// What is known about a cached GIF besides its pixels.
+struct CachedRender {
+    int seed = 0; // Seed the GIF was rendered with
+    std::vector<std::uint64_t> frame_checksums; // Empty unless recorded when it was rendered
+};
+
+// Finished GIFs on disk, addressed by a hash of everything that determines
+// their content: the source image's bytes, the settings and
+// RENDERER_VERSION. Entries are written atomically, so readers never see a
+// partial file even across processes, and the least recently used ones are
+// deleted once the directory grows past its size limit. Thread-safe.
+class RenderCache {
+public:
+    static const qint64 DEFAULT_MAX_BYTES = 1024LL * 1024 * 1024;
+
+    explicit RenderCache(const QString& directory, qint64 max_bytes = DEFAULT_MAX_BYTES);
+
+    // The per-user cache directory of the application.
+    static QString defaultDirectory();
+
+    // SHA-256 of the image file at `image_path`, from which the keys of its
+    // renders are derived; hash each source once per job. Empty if the file
+    // cannot be read.
+    static QByteArray sourceDigest(const std::string& image_path);
+
+    // Key of a render of `settings` from an image with `source_digest`. The
+    // path itself is not part of the key, only the file's content. Empty if
+    // `source_digest` is, or if settings.seed is 0: such a
+    // render draws a new starfield every time, so it is never served from
+    // the cache, but is stored under the seed it drew.
+    static QString key(const QByteArray& source_digest, const GifSettings& settings);
+
+    // Whether a GIF is cached under `key`, e.g. to skip decoding the source.
+    bool contains(const QString& key) const;
+    // Copies the GIF cached under `key` to `output_path`. Returns false on a miss.
+    bool fetch(const QString& key, const QString& output_path, CachedRender* info = nullptr);
+    // Adds the GIF at `gif_path` under `key`, then evicts down to the size limit.
+    bool store(const QString& key, const QString& gif_path, const CachedRender& info);
+
+    QString directory() const { return m_directory; }
+
+private:
+    QString m_directory;
+    qint64 m_max_bytes;
+
+    QString gifPath(const QString& key) const;
+    QString infoPath(const QString& key) const;
+    void evict() const;
+};
+
+#endif // RENDER_CACHE_H
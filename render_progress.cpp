@@ -0,0 +1,68 @@
+// render_progress.cpp
+#include "render_progress.h"
+
+namespace {
+
+std::int64_t nowNsecs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Exponential moving average with weight 1/8 for the newest sample. The
+// first sample seeds the average.
+void updateAverage(std::atomic<std::int64_t>& average, std::chrono::steady_clock::duration sample) {
+    std::int64_t sample_nsecs = std::chrono::duration_cast<std::chrono::nanoseconds>(sample).count();
+    std::int64_t current = average.load(std::memory_order_relaxed);
+    std::int64_t updated;
+    do {
+        updated = current == 0 ? sample_nsecs : current + (sample_nsecs - current) / 8;
+    } while (!average.compare_exchange_weak(current, updated, std::memory_order_relaxed));
+}
+
+} // namespace
+
+double RenderProgress::Snapshot::etaSecs() const {
+    if (frames_encoded <= 0) return -1.0;
+    return (total_frames - frames_encoded) * elapsed_secs / frames_encoded;
+}
+
+void RenderProgress::start(int total_frames) {
+    m_frames_rendered.store(0, std::memory_order_relaxed);
+    m_frames_encoded.store(0, std::memory_order_relaxed);
+    m_bytes_written.store(0, std::memory_order_relaxed);
+    m_avg_render_nsecs.store(0, std::memory_order_relaxed);
+    m_avg_encode_nsecs.store(0, std::memory_order_relaxed);
+    m_start_nsecs.store(nowNsecs(), std::memory_order_relaxed);
+    m_total_frames.store(total_frames, std::memory_order_release);
+}
+
+void RenderProgress::frameRendered(std::chrono::steady_clock::duration render_time) {
+    updateAverage(m_avg_render_nsecs, render_time);
+    m_frames_rendered.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RenderProgress::frameEncoded(std::chrono::steady_clock::duration encode_time, std::int64_t bytes_written) {
+    updateAverage(m_avg_encode_nsecs, encode_time);
+    m_bytes_written.store(bytes_written, std::memory_order_relaxed);
+    m_frames_encoded.fetch_add(1, std::memory_order_relaxed);
+}
+
+void RenderProgress::complete(std::int64_t bytes_written) {
+    int total_frames = m_total_frames.load(std::memory_order_relaxed);
+    m_bytes_written.store(bytes_written, std::memory_order_relaxed);
+    m_frames_rendered.store(total_frames, std::memory_order_relaxed);
+    m_frames_encoded.store(total_frames, std::memory_order_relaxed);
+}
+
+RenderProgress::Snapshot RenderProgress::snapshot() const {
+    Snapshot snapshot;
+    snapshot.total_frames = m_total_frames.load(std::memory_order_acquire);
+    snapshot.frames_rendered = m_frames_rendered.load(std::memory_order_relaxed);
+    snapshot.frames_encoded = m_frames_encoded.load(std::memory_order_relaxed);
+    snapshot.bytes_written = m_bytes_written.load(std::memory_order_relaxed);
+    snapshot.avg_render_msecs = m_avg_render_nsecs.load(std::memory_order_relaxed) / 1e6;
+    snapshot.avg_encode_msecs = m_avg_encode_nsecs.load(std::memory_order_relaxed) / 1e6;
+    std::int64_t start_nsecs = m_start_nsecs.load(std::memory_order_relaxed);
+    snapshot.elapsed_secs = start_nsecs > 0 ? (nowNsecs() - start_nsecs) / 1e9 : 0.0;
+    return snapshot;
+}
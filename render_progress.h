@@ -0,0 +1,47 @@
+// render_progress.h
+#ifndef RENDER_PROGRESS_H
+#define RENDER_PROGRESS_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// Progress of one GIF job. The threads doing the work bump lock-free
+// counters; whoever displays progress samples them on its own timer, so a
+// frame costs a few atomic operations no matter how many threads render.
+class RenderProgress {
+public:
+    struct Snapshot {
+        int total_frames = 0;
+        int frames_rendered = 0;
+        int frames_encoded = 0;
+        std::int64_t bytes_written = 0; // GIF bytes on disk so far
+        double avg_render_msecs = 0.0;  // Moving averages per frame
+        double avg_encode_msecs = 0.0;
+        double elapsed_secs = 0.0;
+
+        int percent() const { return total_frames > 0 ? frames_encoded * 100 / total_frames : 0; }
+        double framesPerSecond() const { return elapsed_secs > 0.0 ? frames_encoded / elapsed_secs : 0.0; }
+        // Seconds left at the rate so far; negative until a frame is done.
+        double etaSecs() const;
+    };
+
+    // Starts the clock for a job of `total_frames` frames.
+    void start(int total_frames);
+    void frameRendered(std::chrono::steady_clock::duration render_time);
+    void frameEncoded(std::chrono::steady_clock::duration encode_time, std::int64_t bytes_written);
+    // Marks every frame done at once, e.g. when the GIF came from a cache.
+    void complete(std::int64_t bytes_written);
+    Snapshot snapshot() const;
+
+private:
+    std::atomic<int> m_total_frames{0};
+    std::atomic<int> m_frames_rendered{0};
+    std::atomic<int> m_frames_encoded{0};
+    std::atomic<std::int64_t> m_bytes_written{0};
+    std::atomic<std::int64_t> m_avg_render_nsecs{0};
+    std::atomic<std::int64_t> m_avg_encode_nsecs{0};
+    std::atomic<std::int64_t> m_start_nsecs{0};
+};
+
+#endif // RENDER_PROGRESS_H
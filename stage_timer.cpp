@@ -0,0 +1,141 @@
+// stage_timer.cpp
+#include "stage_timer.h"
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+namespace {
+
+thread_local StageProfile* t_current_profile = nullptr;
+
+double toMsecs(StageProfile::Clock::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+} // namespace
+
+void AllocationStats::recordAllocation(std::size_t bytes, bool from_heap) {
+    std::int64_t size = static_cast<std::int64_t>(bytes);
+    m_allocations.fetch_add(1, std::memory_order_relaxed);
+    m_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (from_heap) {
+        m_heap_allocations.fetch_add(1, std::memory_order_relaxed);
+        m_heap_bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    std::int64_t live = m_live_bytes.fetch_add(size, std::memory_order_relaxed) + size;
+    std::int64_t peak = m_peak_bytes.load(std::memory_order_relaxed);
+    while (live > peak && !m_peak_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) {
+    }
+}
+
+void AllocationStats::recordRelease(std::size_t bytes) {
+    m_live_bytes.fetch_sub(static_cast<std::int64_t>(bytes), std::memory_order_relaxed);
+}
+
+QJsonObject AllocationStats::toJson() const {
+    return QJsonObject{
+        {"allocations", static_cast<qint64>(allocations())},
+        {"heap_allocations", static_cast<qint64>(heapAllocations())},
+        {"bytes", static_cast<qint64>(m_bytes.load(std::memory_order_relaxed))},
+        {"heap_bytes", static_cast<qint64>(m_heap_bytes.load(std::memory_order_relaxed))},
+        {"peak_bytes", static_cast<qint64>(m_peak_bytes.load(std::memory_order_relaxed))}};
+}
+
+void StageProfile::record(const char* stage, Clock::time_point start, Clock::time_point end) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_events.push_back(Event{stage, std::this_thread::get_id(), start, end - start});
+}
+
+std::vector<StageProfile::Event> StageProfile::events() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_events;
+}
+
+std::vector<StageProfile::StageTotal> StageProfile::totals() const {
+    std::vector<StageTotal> totals;
+    for (const Event& event : events()) {
+        auto it = std::find_if(totals.begin(), totals.end(),
+                               [&event](const StageTotal& total) { return std::strcmp(total.stage, event.stage) == 0; });
+        if (it == totals.end()) {
+            totals.push_back(StageTotal{event.stage, 0, 0.0, 0.0});
+            it = totals.end() - 1;
+        }
+        double msecs = toMsecs(event.duration);
+        ++it->count;
+        it->total_msecs += msecs;
+        it->max_msecs = std::max(it->max_msecs, msecs);
+    }
+    return totals;
+}
+
+QJsonObject StageProfile::toJson() const {
+    QJsonObject stages;
+    for (const StageTotal& total : totals()) {
+        stages.insert(total.stage, QJsonObject{
+            {"count", total.count},
+            {"total_ms", total.total_msecs},
+            {"max_ms", total.max_msecs}});
+    }
+    return stages;
+}
+
+bool writeChromeTrace(const QString& path, const std::vector<const StageProfile*>& profiles, QString* error) {
+    std::vector<std::vector<StageProfile::Event>> job_events;
+    StageProfile::Clock::time_point origin = StageProfile::Clock::time_point::max();
+    for (const StageProfile* profile : profiles) {
+        job_events.push_back(profile ? profile->events() : std::vector<StageProfile::Event>());
+        for (const StageProfile::Event& event : job_events.back()) {
+            origin = std::min(origin, event.start);
+        }
+    }
+
+    // Trace viewers want small integer thread ids; number threads as they appear.
+    std::map<std::thread::id, int> thread_ids;
+    QJsonArray trace_events;
+    for (size_t job = 0; job < job_events.size(); ++job) {
+        for (const StageProfile::Event& event : job_events[job]) {
+            auto inserted = thread_ids.emplace(event.thread, static_cast<int>(thread_ids.size()) + 1);
+            trace_events.append(QJsonObject{
+                {"name", event.stage},
+                {"cat", "gif"},
+                {"ph", "X"},
+                {"ts", std::chrono::duration<double, std::micro>(event.start - origin).count()},
+                {"dur", std::chrono::duration<double, std::micro>(event.duration).count()},
+                {"pid", 1},
+                {"tid", inserted.first->second},
+                {"args", QJsonObject{{"job", static_cast<int>(job)}}}});
+        }
+    }
+    for (const auto& thread : thread_ids) {
+        trace_events.append(QJsonObject{
+            {"name", "thread_name"},
+            {"ph", "M"},
+            {"pid", 1},
+            {"tid", thread.second},
+            {"args", QJsonObject{{"name", QString("Thread %1").arg(thread.second)}}}});
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        if (error) *error = QString("Cannot write trace '%1'.").arg(path);
+        return false;
+    }
+    QJsonObject trace{{"traceEvents", trace_events}, {"displayTimeUnit", "ms"}};
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+    return true;
+}
+
+StageProfileScope::StageProfileScope(StageProfile* profile) : m_previous(t_current_profile) {
+    t_current_profile = profile;
+}
+
+StageProfileScope::~StageProfileScope() {
+    t_current_profile = m_previous;
+}
+
+StageProfile* currentStageProfile() {
+    return t_current_profile;
+}
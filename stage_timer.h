@@ -0,0 +1,119 @@
+// stage_timer.h
+#ifndef STAGE_TIMER_H
+#define STAGE_TIMER_H
+
+#include <QJsonObject>
+#include <QString>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Counts the cv::Mat buffers one job asked for and how many of them had to
+// come from the heap rather than a pool. Thread-safe.
+class AllocationStats {
+public:
+    void recordAllocation(std::size_t bytes, bool from_heap);
+    void recordRelease(std::size_t bytes);
+
+    std::int64_t allocations() const { return m_allocations.load(std::memory_order_relaxed); }
+    std::int64_t heapAllocations() const { return m_heap_allocations.load(std::memory_order_relaxed); }
+    // { "allocations": n, "heap_allocations": n, "bytes": b, "heap_bytes": b, "peak_bytes": b }
+    QJsonObject toJson() const;
+
+private:
+    std::atomic<std::int64_t> m_allocations{0};
+    std::atomic<std::int64_t> m_heap_allocations{0};
+    std::atomic<std::int64_t> m_bytes{0};
+    std::atomic<std::int64_t> m_heap_bytes{0};
+    std::atomic<std::int64_t> m_live_bytes{0};
+    std::atomic<std::int64_t> m_peak_bytes{0};
+};
+
+// Where one job spent its time: every timed stage run, by the thread that
+// ran it. Thread-safe, so the frames of one job may be rendered in parallel.
+class StageProfile {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Event {
+        const char* stage; // A string literal, compared by content
+        std::thread::id thread;
+        Clock::time_point start;
+        Clock::duration duration;
+    };
+
+    struct StageTotal {
+        const char* stage;
+        int count;
+        double total_msecs;
+        double max_msecs;
+    };
+
+    void record(const char* stage, Clock::time_point start, Clock::time_point end);
+    std::vector<Event> events() const;
+    // One entry per stage, in the order the stages first ran.
+    std::vector<StageTotal> totals() const;
+    // { "<stage>": { "count": n, "total_ms": t, "max_ms": m }, ... }
+    QJsonObject toJson() const;
+
+    // Filled by PooledMatAllocator while the job's scope is active.
+    AllocationStats& allocations() { return m_allocations; }
+    const AllocationStats& allocations() const { return m_allocations; }
+
+private:
+    mutable std::mutex m_mutex;
+    std::vector<Event> m_events;
+    AllocationStats m_allocations;
+};
+
+// Writes the events of `profiles` as a Chrome trace_event file, which
+// chrome://tracing and Perfetto show as one timeline per thread. Each event
+// carries the index of its profile as "job".
+bool writeChromeTrace(const QString& path, const std::vector<const StageProfile*>& profiles, QString* error = nullptr);
+
+// Sends the stage timers of the calling thread to `profile` until destroyed.
+// Timers on a thread without a scope record nothing.
+class StageProfileScope {
+public:
+    explicit StageProfileScope(StageProfile* profile);
+    ~StageProfileScope();
+    StageProfileScope(const StageProfileScope&) = delete;
+    StageProfileScope& operator=(const StageProfileScope&) = delete;
+
+private:
+    StageProfile* m_previous;
+};
+
+StageProfile* currentStageProfile();
+
+// Times the enclosing block as `stage`. Use GIF_STAGE_TIMER, which compiles
+// to nothing unless the build defines GIF_STAGE_TIMERS.
+class ScopedStageTimer {
+public:
+    explicit ScopedStageTimer(const char* stage) : m_stage(stage), m_profile(currentStageProfile()) {
+        if (m_profile) m_start = StageProfile::Clock::now();
+    }
+    ~ScopedStageTimer() {
+        if (m_profile) m_profile->record(m_stage, m_start, StageProfile::Clock::now());
+    }
+    ScopedStageTimer(const ScopedStageTimer&) = delete;
+    ScopedStageTimer& operator=(const ScopedStageTimer&) = delete;
+
+private:
+    const char* m_stage;
+    StageProfile* m_profile;
+    StageProfile::Clock::time_point m_start;
+};
+
+#ifdef GIF_STAGE_TIMERS
+#define GIF_STAGE_TIMER_CONCAT_(a, b) a##b
+#define GIF_STAGE_TIMER_CONCAT(a, b) GIF_STAGE_TIMER_CONCAT_(a, b)
+#define GIF_STAGE_TIMER(stage) ScopedStageTimer GIF_STAGE_TIMER_CONCAT(stage_timer_, __LINE__)(stage)
+#else
+#define GIF_STAGE_TIMER(stage) static_cast<void>(0)
+#endif
+
+#endif // STAGE_TIMER_H